@@ -0,0 +1,352 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SLChunkedTilemap.h"
+#include "SLTilemap.h"
+#include "SLTilemapFile.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+
+
+namespace
+{
+	//Rounds towards negative infinity, so tiles left of or above the origin land in chunk -1 rather than 0
+	int32 FloorDivide(const int32 A, const int32 B)
+	{
+		const int32 Quotient = A / B;
+		return A % B != 0 && (A < 0) != (B < 0) ? Quotient - 1 : Quotient;
+	}
+
+	//Solved neighbor of a chunk, either loaded already or to be read from Path by the chunk's task
+	struct FChunkNeighbor
+	{
+		FIntPoint Offset;
+		FTileMap TileMap;
+		FString Path;
+	};
+
+	//Thread safe, false if Path doesn't hold a chunk of ChunkSize
+	bool LoadChunkFile(const FString& Path, const int32 ChunkSize, FTileMap& OutTileMap)
+	{
+		return IFileManager::Get().FileExists(*Path) && FTileMapFile::Load(Path, OutTileMap) && OutTileMap.SizeX == ChunkSize && OutTileMap.SizeY == ChunkSize;
+	}
+}
+
+
+void USLChunkedTilemap::UpdateStreaming(const TArray<FIntPoint>& CenterChunks)
+{
+	FinishChunkSaves(false);
+	FinishChunkSolves();
+
+	//Evict chunks out of range of every center
+	TArray<FIntPoint> ChunksToEvict;
+	for (const auto& Pair : LoadedChunks)
+	{
+		bool InRange = false;
+		for (const FIntPoint& Center : CenterChunks)
+		{
+			const FIntPoint Delta = Pair.Key - Center;
+			InRange |= FMath::Max(FMath::Abs(Delta.X), FMath::Abs(Delta.Y)) <= LoadRadius;
+		}
+		if (!InRange)
+		{
+			ChunksToEvict.Add(Pair.Key);
+		}
+	}
+	for (const FIntPoint& Chunk : ChunksToEvict)
+	{
+		EvictChunk(Chunk);
+	}
+
+	//Gather missing chunks, nearest to a center first
+	TArray<FIntPoint> MissingChunks;
+	TMap<FIntPoint, int32> MissingChunkDistances;
+	for (const FIntPoint& Center : CenterChunks)
+	{
+		for (int32 Y = -LoadRadius; Y <= LoadRadius; Y++)
+		{
+			for (int32 X = -LoadRadius; X <= LoadRadius; X++)
+			{
+				const FIntPoint Chunk = Center + FIntPoint(X, Y);
+				if (LoadedChunks.Contains(Chunk) || ChunkSolves.Contains(Chunk))
+				{
+					continue;
+				}
+				const int32 Distance = FMath::Max(FMath::Abs(X), FMath::Abs(Y));
+				int32* KnownDistance = MissingChunkDistances.Find(Chunk);
+				if (!KnownDistance)
+				{
+					MissingChunks.Add(Chunk);
+					MissingChunkDistances.Add(Chunk, Distance);
+				}
+				else
+				{
+					*KnownDistance = FMath::Min(*KnownDistance, Distance);
+				}
+			}
+		}
+	}
+	MissingChunks.StableSort([&MissingChunkDistances](const FIntPoint& A, const FIntPoint& B)
+	{
+		return MissingChunkDistances[A] < MissingChunkDistances[B];
+	});
+
+	//Chunks that can't start solving yet are skipped in favor of further ones
+	const int32 NumChunksToLoad = MaxChunksPerUpdate > 0 ? MaxChunksPerUpdate : MissingChunks.Num();
+	int32 NumChunksLoaded = 0;
+	for (int32 i = 0; i < MissingChunks.Num() && NumChunksLoaded < NumChunksToLoad; i++)
+	{
+		NumChunksLoaded += StartChunk(MissingChunks[i]) ? 1 : 0;
+	}
+}
+
+void USLChunkedTilemap::FlushToDisk()
+{
+	FinishChunkSaves(true);
+	for (const auto& Pair : LoadedChunks)
+	{
+		if (!FailedChunks.Contains(Pair.Key))
+		{
+			FTileMapFile::Save(GetChunkPath(Pair.Key), Pair.Value, ETileMapCompression::RLE);
+		}
+	}
+}
+
+bool USLChunkedTilemap::IsChunkLoaded(const FIntPoint& Chunk) const
+{
+	return LoadedChunks.Contains(Chunk);
+}
+
+bool USLChunkedTilemap::IsChunkSolving(const FIntPoint& Chunk) const
+{
+	return ChunkSolves.Contains(Chunk);
+}
+
+bool USLChunkedTilemap::GetChunk(const FIntPoint& Chunk, FTileMap& OutTileMap) const
+{
+	const FTileMap* TileMap = LoadedChunks.Find(Chunk);
+	if (!TileMap)
+	{
+		return false;
+	}
+	OutTileMap = *TileMap;
+	return true;
+}
+
+FIntPoint USLChunkedTilemap::TileToChunk(const int32 X, const int32 Y) const
+{
+	return FIntPoint(FloorDivide(X, ChunkSize), FloorDivide(Y, ChunkSize));
+}
+
+uint8 USLChunkedTilemap::GetTileAtXY(const int32 X, const int32 Y) const
+{
+	const FIntPoint Chunk = TileToChunk(X, Y);
+	const FTileMap* TileMap = LoadedChunks.Find(Chunk);
+	if (!TileMap)
+	{
+		return 0;
+	}
+	if (FailedChunks.Contains(Chunk))
+	{
+		return static_cast<uint8>(ETileState::Void);
+	}
+	return USLTilemapLib::GetTileAtXY(*TileMap, X - Chunk.X * ChunkSize, Y - Chunk.Y * ChunkSize);
+}
+
+int32 USLChunkedTilemap::GetNumLoadedChunks() const
+{
+	return LoadedChunks.Num();
+}
+
+void USLChunkedTilemap::BeginDestroy()
+{
+	//Solves hold raw pointers to Waves, so they must be done before the waves can go
+	for (auto& Pair : ChunkSolves)
+	{
+		Pair.Value.Wave->Cancel();
+	}
+	for (auto& Pair : ChunkSolves)
+	{
+		Pair.Value.Result.Wait();
+	}
+	ChunkSolves.Empty();
+	FinishChunkSaves(true);
+	Super::BeginDestroy();
+}
+
+bool USLChunkedTilemap::StartChunk(const FIntPoint& Chunk)
+{
+	//Neighbors being solved can't seed this chunk's apron yet, and files being written can't be read
+	if (ChunkSolves.Num() >= MaxChunkSolves || IsNextToChunkTask(Chunk))
+	{
+		return false;
+	}
+
+	//Aprons are seeded from loaded neighbors here, the task reads the others from disk if they are there
+	TArray<FChunkNeighbor> Neighbors;
+	for (int32 NeighborY = -1; NeighborY <= 1; NeighborY++)
+	{
+		for (int32 NeighborX = -1; NeighborX <= 1; NeighborX++)
+		{
+			const FIntPoint Neighbor = Chunk + FIntPoint(NeighborX, NeighborY);
+			if (Neighbor == Chunk || FailedChunks.Contains(Neighbor))
+			{
+				continue;
+			}
+			FChunkNeighbor& ChunkNeighbor = Neighbors.AddDefaulted_GetRef();
+			ChunkNeighbor.Offset = FIntPoint(NeighborX, NeighborY) * ChunkSize;
+			if (!GetChunk(Neighbor, ChunkNeighbor.TileMap))
+			{
+				ChunkNeighbor.Path = GetChunkPath(Neighbor);
+			}
+		}
+	}
+
+	//Waves are UObjects so they are created here, each keeps its pattern tables between chunks
+	USLWave* Wave = IdleWaves.Num() > 0 ? IdleWaves.Pop(false) : Waves.Add_GetRef(NewObject<USLWave>(this));
+	Wave->InputTileMap = InputTileMap;
+	Wave->PatternSize = PatternSize;
+	Wave->Symmetry = Symmetry;
+	Wave->ClearCancel();
+
+	const FString Path = GetChunkPath(Chunk);
+	const int32 Size = ChunkSize;
+	const int32 BaseSeed = HashCombine(GetTypeHash(Seed), GetTypeHash(Chunk));
+	const int32 NumAttempts = MaxAttempts;
+	FChunkSolve& ChunkSolve = ChunkSolves.Add(Chunk);
+	ChunkSolve.Wave = Wave;
+	ChunkSolve.Result = Async(EAsyncExecution::ThreadPool, [Wave, Chunk, Path, Size, Neighbors = MoveTemp(Neighbors), BaseSeed, NumAttempts]()
+	{
+		FChunkResult Result;
+		if (LoadChunkFile(Path, Size, Result.TileMap))
+		{
+			Result.bSolved = true;
+			return Result;
+		}
+		const double StartTime = FPlatformTime::Seconds();
+
+		//Solve the chunk plus an apron wide enough for every window crossing its border, fixing the tiles of solved neighbors
+		const int32 Overlap = Wave->PatternSize - 1;
+		const FTileMap UnseededMap = FTileMap(Size + 2 * Overlap, Size + 2 * Overlap, 0xFF);
+		FTileMap SolveMap = UnseededMap;
+		for (const FChunkNeighbor& Neighbor : Neighbors)
+		{
+			FTileMap NeighborTileMap;
+			if (Neighbor.Path.IsEmpty() || LoadChunkFile(Neighbor.Path, Size, NeighborTileMap))
+			{
+				USLTilemapLib::PasteRegion(SolveMap, Neighbor.Path.IsEmpty() ? Neighbor.TileMap : NeighborTileMap, Neighbor.Offset.X + Overlap, Neighbor.Offset.Y + Overlap);
+			}
+		}
+
+		//Retry with new seeds on contradiction, keeping the last attempt if all of them fail
+		bool Solved = false;
+		bool Unseeded = false;
+		for (int32 Attempt = 0; Attempt < NumAttempts && !Solved; Attempt++)
+		{
+			Wave->OutputTileMap = SolveMap;
+			Wave->Seed = BaseSeed + Attempt;
+			Solved = Wave->Run();
+			//Cancelled or unsolvable input, more seeds won't help
+			if (!Solved && !Wave->HasFailed())
+			{
+				break;
+			}
+			//Initialize doesn't depend on the seed, so an apron that contradicts itself fails every attempt.
+			//Dropping it solves the chunk at the cost of seams that may not match its neighbors
+			if (!Solved && Wave->GetStats().NumSteps == 0)
+			{
+				if (Unseeded)
+				{
+					break;
+				}
+				UE_LOG(LogSLTilemap, Warning, TEXT("Chunk %d, %d has a contradicting apron, solving it without one"), Chunk.X, Chunk.Y);
+				SolveMap = UnseededMap;
+				Unseeded = true;
+			}
+		}
+		if (!Solved)
+		{
+			UE_LOG(LogSLTilemap, Warning, TEXT("Chunk %d, %d failed to solve after %d attempts"), Chunk.X, Chunk.Y, NumAttempts);
+		}
+		const double EndTime = FPlatformTime::Seconds();
+		UE_LOG(LogSLTilemap, Log, TEXT("Chunk %d, %d took %f ms"), Chunk.X, Chunk.Y, 1000 * (EndTime - StartTime));
+		Result.TileMap = USLTilemapLib::GetTilemapSection(Wave->OutputTileMap, Overlap, Overlap, Size, Size);
+		Result.bSolved = Solved;
+		return Result;
+	});
+	return true;
+}
+
+void USLChunkedTilemap::FinishChunkSolves()
+{
+	for (auto It = ChunkSolves.CreateIterator(); It; ++It)
+	{
+		FChunkSolve& ChunkSolve = It.Value();
+		if (!ChunkSolve.Result.IsReady())
+		{
+			continue;
+		}
+		//Chunks out of range by now are loaded anyway and evicted, and so saved, by the caller
+		const FChunkResult& Result = ChunkSolve.Result.Get();
+		if (!Result.bSolved)
+		{
+			FailedChunks.Add(It.Key());
+		}
+		LoadedChunks.Add(It.Key(), Result.TileMap);
+		IdleWaves.Add(ChunkSolve.Wave);
+		It.RemoveCurrent();
+	}
+}
+
+void USLChunkedTilemap::FinishChunkSaves(const bool bWait)
+{
+	for (auto It = ChunkSaves.CreateIterator(); It; ++It)
+	{
+		if (!bWait && !It.Value().IsReady())
+		{
+			continue;
+		}
+		if (!It.Value().Get())
+		{
+			UE_LOG(LogSLTilemap, Warning, TEXT("Could not write chunk %d, %d to %s"), It.Key().X, It.Key().Y, *GetChunkPath(It.Key()));
+		}
+		It.RemoveCurrent();
+	}
+}
+
+bool USLChunkedTilemap::IsNextToChunkTask(const FIntPoint& Chunk) const
+{
+	for (int32 NeighborY = -1; NeighborY <= 1; NeighborY++)
+	{
+		for (int32 NeighborX = -1; NeighborX <= 1; NeighborX++)
+		{
+			const FIntPoint Neighbor = Chunk + FIntPoint(NeighborX, NeighborY);
+			if (ChunkSolves.Contains(Neighbor) || ChunkSaves.Contains(Neighbor))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void USLChunkedTilemap::EvictChunk(const FIntPoint& Chunk)
+{
+	FTileMap TileMap;
+	if (LoadedChunks.RemoveAndCopyValue(Chunk, TileMap) && !FailedChunks.Contains(Chunk))
+	{
+		const FString Path = GetChunkPath(Chunk);
+		ChunkSaves.Add(Chunk, Async(EAsyncExecution::ThreadPool, [Path, TileMap = MoveTemp(TileMap)]()
+		{
+			return FTileMapFile::Save(Path, TileMap, ETileMapCompression::RLE);
+		}));
+	}
+	FailedChunks.Remove(Chunk);
+}
+
+FString USLChunkedTilemap::GetChunkPath(const FIntPoint& Chunk) const
+{
+	const FString Directory = ChunkDirectory.IsEmpty() ? FPaths::ProjectSavedDir() / TEXT("TilemapChunks") : ChunkDirectory;
+	return Directory / FString::Printf(TEXT("Chunk_%d_%d.sltm"), Chunk.X, Chunk.Y);
+}
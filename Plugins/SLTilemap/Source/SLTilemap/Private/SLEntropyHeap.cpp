@@ -0,0 +1,160 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SLEntropyHeap.h"
+
+
+void FEntropyHeap::Build(const TArray<float>& Keys, const TArray<uint32>& TieBreaks)
+{
+	check(TieBreaks.Num() == Keys.Num());
+	const int32 NumKeys = Keys.Num();
+	HeapKeys = Keys;
+	HeapTieBreaks = TieBreaks;
+	Heap.SetNum(NumKeys);
+	HeapPositions.SetNum(NumKeys);
+	for (int32 i = 0; i < NumKeys; i++)
+	{
+		Heap[i] = i;
+		HeapPositions[i] = i;
+	}
+	for (int32 Position = NumKeys / 2 - 1; Position >= 0; Position--)
+	{
+		SiftDown(Position);
+	}
+}
+
+void FEntropyHeap::Empty()
+{
+	Heap.Empty();
+	HeapPositions.Empty();
+	HeapKeys.Empty();
+	HeapTieBreaks.Empty();
+}
+
+void FEntropyHeap::Update(const int32 Index, const float Key)
+{
+	if (Index >= HeapPositions.Num())
+	{
+		const int32 OldNum = HeapPositions.Num();
+		HeapPositions.SetNum(Index + 1);
+		HeapKeys.SetNum(Index + 1);
+		HeapTieBreaks.SetNum(Index + 1);
+		for (int32 i = OldNum; i <= Index; i++)
+		{
+			HeapPositions[i] = INDEX_NONE;
+			HeapTieBreaks[i] = 0;
+		}
+	}
+	HeapKeys[Index] = Key;
+	int32 Position = HeapPositions[Index];
+	if (Position == INDEX_NONE)
+	{
+		Position = Heap.Add(Index);
+		HeapPositions[Index] = Position;
+	}
+	SiftUp(Position);
+	SiftDown(HeapPositions[Index]);
+}
+
+void FEntropyHeap::Remove(const int32 Index)
+{
+	if (!Contains(Index))
+	{
+		return;
+	}
+	const int32 Position = HeapPositions[Index];
+	const int32 LastPosition = Heap.Num() - 1;
+	SwapPositions(Position, LastPosition);
+	Heap.Pop(false);
+	HeapPositions[Index] = INDEX_NONE;
+	if (Position < Heap.Num())
+	{
+		SiftUp(Position);
+		SiftDown(Position);
+	}
+}
+
+bool FEntropyHeap::Pop(int32& OutIndex)
+{
+	if (Heap.Num() == 0)
+	{
+		return false;
+	}
+	OutIndex = Heap[0];
+	Remove(OutIndex);
+	return true;
+}
+
+bool FEntropyHeap::Contains(const int32 Index) const
+{
+	return HeapPositions.IsValidIndex(Index) && HeapPositions[Index] != INDEX_NONE;
+}
+
+int32 FEntropyHeap::Num() const
+{
+	return Heap.Num();
+}
+
+SIZE_T FEntropyHeap::GetAllocatedSize() const
+{
+	return Heap.GetAllocatedSize() + HeapPositions.GetAllocatedSize() + HeapKeys.GetAllocatedSize() + HeapTieBreaks.GetAllocatedSize();
+}
+
+bool FEntropyHeap::IsLess(const int32 A, const int32 B) const
+{
+	const float KeyA = HeapKeys[Heap[A]];
+	const float KeyB = HeapKeys[Heap[B]];
+	if (KeyA != KeyB)
+	{
+		return KeyA < KeyB;
+	}
+	const uint32 TieBreakA = HeapTieBreaks[Heap[A]];
+	const uint32 TieBreakB = HeapTieBreaks[Heap[B]];
+	return TieBreakA < TieBreakB || (TieBreakA == TieBreakB && Heap[A] < Heap[B]);
+}
+
+void FEntropyHeap::SiftUp(int32 Position)
+{
+	while (Position > 0)
+	{
+		const int32 Parent = (Position - 1) / 2;
+		if (!IsLess(Position, Parent))
+		{
+			break;
+		}
+		SwapPositions(Position, Parent);
+		Position = Parent;
+	}
+}
+
+void FEntropyHeap::SiftDown(int32 Position)
+{
+	const int32 HeapNum = Heap.Num();
+	while (true)
+	{
+		const int32 Left = 2 * Position + 1;
+		const int32 Right = Left + 1;
+		int32 Smallest = Position;
+		if (Left < HeapNum && IsLess(Left, Smallest))
+		{
+			Smallest = Left;
+		}
+		if (Right < HeapNum && IsLess(Right, Smallest))
+		{
+			Smallest = Right;
+		}
+		if (Smallest == Position)
+		{
+			break;
+		}
+		SwapPositions(Position, Smallest);
+		Position = Smallest;
+	}
+}
+
+void FEntropyHeap::SwapPositions(const int32 A, const int32 B)
+{
+	Heap.Swap(A, B);
+	HeapPositions[Heap[A]] = A;
+	HeapPositions[Heap[B]] = B;
+}
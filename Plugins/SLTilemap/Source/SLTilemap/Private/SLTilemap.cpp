@@ -2,6 +2,8 @@
 
 #include "SLTilemap.h"
 
+DEFINE_LOG_CATEGORY(LogSLTilemap);
+
 #define LOCTEXT_NAMESPACE "FSLTilemapModule"
 
 void FSLTilemapModule::StartupModule()
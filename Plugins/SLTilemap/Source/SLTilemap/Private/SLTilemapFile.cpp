@@ -0,0 +1,283 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SLTilemapFile.h"
+#include "SLTilemap.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+
+
+FTileMapFile::FTileMapFile()
+{
+}
+
+FTileMapFile::~FTileMapFile()
+{
+	Close();
+}
+
+bool FTileMapFile::Save(const FString& Path, const TArray<FString>& Names, const TArray<FTileMap>& TileMaps, const ETileMapCompression Compression)
+{
+	check(Names.Num() == TileMaps.Num());
+	TArray<FEntry> FileEntries;
+	FileEntries.SetNumZeroed(TileMaps.Num());
+	TArray<uint8> NameBytes;
+	TArray<uint8> DataBytes;
+	for (int32 i = 0; i < TileMaps.Num(); i++)
+	{
+		const FTileMap& TileMap = TileMaps[i];
+		FEntry& Entry = FileEntries[i];
+		const FTCHARToUTF8 Name(*Names[i]);
+		Entry.NameOffset = NameBytes.Num();
+		Entry.NameSize = Name.Length();
+		NameBytes.Append(reinterpret_cast<const uint8*>(Name.Get()), Name.Length());
+
+		TArray<uint8> CompressedData;
+		if (Compression == ETileMapCompression::RLE)
+		{
+			CompressRLE(TileMap.Data, CompressedData);
+		}
+		else if (Compression == ETileMapCompression::LZ4)
+		{
+			int32 CompressedSize = FCompression::CompressMemoryBound(NAME_LZ4, TileMap.Data.Num());
+			CompressedData.SetNumUninitialized(CompressedSize);
+			const bool Compressed = FCompression::CompressMemory(NAME_LZ4, CompressedData.GetData(), CompressedSize, TileMap.Data.GetData(), TileMap.Data.Num());
+			CompressedData.SetNum(Compressed ? CompressedSize : 0, false);
+		}
+		const bool UseCompressedData = CompressedData.Num() > 0 && CompressedData.Num() < TileMap.Data.Num();
+		const TArray<uint8>& StoredData = UseCompressedData ? CompressedData : TileMap.Data;
+		Entry.DataOffset = DataBytes.Num();
+		Entry.DataSize = StoredData.Num();
+		Entry.SizeX = TileMap.SizeX;
+		Entry.SizeY = TileMap.SizeY;
+		Entry.Compression = static_cast<int32>(UseCompressedData ? Compression : ETileMapCompression::None);
+		DataBytes.Append(StoredData);
+	}
+
+	//Offsets so far are relative to their own section
+	const int64 NameStart = sizeof(FHeader) + FileEntries.Num() * sizeof(FEntry);
+	const int64 DataStart = NameStart + NameBytes.Num();
+	for (FEntry& Entry : FileEntries)
+	{
+		Entry.NameOffset += NameStart;
+		Entry.DataOffset += DataStart;
+	}
+	FHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Header.NumTileMaps = TileMaps.Num();
+	Header.Reserved = 0;
+
+	TArray<uint8> Bytes;
+	Bytes.Reserve(DataStart + DataBytes.Num());
+	Bytes.Append(reinterpret_cast<const uint8*>(&Header), sizeof(FHeader));
+	Bytes.Append(reinterpret_cast<const uint8*>(FileEntries.GetData()), FileEntries.Num() * sizeof(FEntry));
+	Bytes.Append(NameBytes);
+	Bytes.Append(DataBytes);
+	return FFileHelper::SaveArrayToFile(Bytes, *Path);
+}
+
+bool FTileMapFile::Save(const FString& Path, const FTileMap& TileMap, const ETileMapCompression Compression)
+{
+	return Save(Path, {FString()}, {TileMap}, Compression);
+}
+
+bool FTileMapFile::Load(const FString& Path, FTileMap& OutTileMap)
+{
+	FTileMapFile File;
+	return File.Open(Path) && File.Num() > 0 && File.GetTileMap(0, OutTileMap);
+}
+
+bool FTileMapFile::Open(const FString& Path)
+{
+	Close();
+	MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path));
+	if (MappedFile)
+	{
+		MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+	}
+	if (MappedRegion)
+	{
+		FileData = MappedRegion->GetMappedPtr();
+		FileSize = MappedRegion->GetMappedSize();
+	}
+	else
+	{
+		//Platforms without memory mapping read the whole file instead
+		MappedFile.Reset();
+		if (!FFileHelper::LoadFileToArray(LoadedBytes, *Path))
+		{
+			return false;
+		}
+		FileData = LoadedBytes.GetData();
+		FileSize = LoadedBytes.Num();
+	}
+	if (!Validate())
+	{
+		UE_LOG(LogSLTilemap, Warning, TEXT("%s is not a valid tilemap file"), *Path);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void FTileMapFile::Close()
+{
+	//The region must be released before the file it maps
+	MappedRegion.Reset();
+	MappedFile.Reset();
+	LoadedBytes.Empty();
+	FileData = nullptr;
+	FileSize = 0;
+	Entries = nullptr;
+	NumEntries = 0;
+}
+
+int32 FTileMapFile::Num() const
+{
+	return NumEntries;
+}
+
+FString FTileMapFile::GetName(const int32 Index) const
+{
+	check(Index >= 0 && Index < NumEntries);
+	const FUTF8ToTCHAR Name(reinterpret_cast<const ANSICHAR*>(FileData + Entries[Index].NameOffset), Entries[Index].NameSize);
+	return FString(Name.Length(), Name.Get());
+}
+
+int32 FTileMapFile::Find(const FString& Name) const
+{
+	for (int32 Index = 0; Index < NumEntries; Index++)
+	{
+		if (GetName(Index) == Name)
+		{
+			return Index;
+		}
+	}
+	return INDEX_NONE;
+}
+
+int32 FTileMapFile::GetSizeX(const int32 Index) const
+{
+	check(Index >= 0 && Index < NumEntries);
+	return Entries[Index].SizeX;
+}
+
+int32 FTileMapFile::GetSizeY(const int32 Index) const
+{
+	check(Index >= 0 && Index < NumEntries);
+	return Entries[Index].SizeY;
+}
+
+const uint8* FTileMapFile::GetData(const int32 Index) const
+{
+	check(Index >= 0 && Index < NumEntries);
+	const FEntry& Entry = Entries[Index];
+	return Entry.Compression == static_cast<int32>(ETileMapCompression::None) ? FileData + Entry.DataOffset : nullptr;
+}
+
+bool FTileMapFile::GetTileMap(const int32 Index, FTileMap& OutTileMap) const
+{
+	check(Index >= 0 && Index < NumEntries);
+	const FEntry& Entry = Entries[Index];
+	const uint8* StoredData = FileData + Entry.DataOffset;
+	OutTileMap.SizeX = Entry.SizeX;
+	OutTileMap.SizeY = Entry.SizeY;
+	OutTileMap.Data.SetNumUninitialized(Entry.SizeX * Entry.SizeY);
+	bool bDecoded = false;
+	switch (static_cast<ETileMapCompression>(Entry.Compression))
+	{
+	case ETileMapCompression::None:
+		FMemory::Memcpy(OutTileMap.Data.GetData(), StoredData, Entry.DataSize);
+		bDecoded = true;
+		break;
+	case ETileMapCompression::RLE:
+		bDecoded = DecompressRLE(StoredData, Entry.DataSize, OutTileMap.Data);
+		break;
+	case ETileMapCompression::LZ4:
+		bDecoded = FCompression::UncompressMemory(NAME_LZ4, OutTileMap.Data.GetData(), OutTileMap.Data.Num(), StoredData, Entry.DataSize);
+		break;
+	default:
+		break;
+	}
+	//Every tile is new, dirty regions left from the map's earlier contents would repaint the wrong area
+	if (bDecoded)
+	{
+		OutTileMap.MarkAllDirty();
+	}
+	return bDecoded;
+}
+
+bool FTileMapFile::Validate()
+{
+	FHeader Header;
+	if (FileSize < static_cast<int64>(sizeof(FHeader)))
+	{
+		return false;
+	}
+	FMemory::Memcpy(&Header, FileData, sizeof(FHeader));
+	if (Header.Magic != Magic || Header.Version != Version || Header.NumTileMaps < 0)
+	{
+		return false;
+	}
+	if (sizeof(FHeader) + static_cast<int64>(Header.NumTileMaps) * sizeof(FEntry) > FileSize)
+	{
+		return false;
+	}
+	Entries = reinterpret_cast<const FEntry*>(FileData + sizeof(FHeader));
+	NumEntries = Header.NumTileMaps;
+	for (int32 Index = 0; Index < NumEntries; Index++)
+	{
+		const FEntry& Entry = Entries[Index];
+		const int64 NumTiles = static_cast<int64>(Entry.SizeX) * Entry.SizeY;
+		const bool SizeValid = Entry.SizeX >= 0 && Entry.SizeY >= 0 && NumTiles <= MAX_int32;
+		const bool DataInFile = Entry.DataOffset >= 0 && Entry.DataSize >= 0 && Entry.DataOffset + Entry.DataSize <= FileSize;
+		const bool NameInFile = Entry.NameOffset >= 0 && Entry.NameSize >= 0 && static_cast<int64>(Entry.NameOffset) + Entry.NameSize <= FileSize;
+		const bool CompressionValid = Entry.Compression >= 0 && Entry.Compression <= static_cast<int32>(ETileMapCompression::LZ4);
+		const bool UncompressedSizeValid = Entry.Compression != static_cast<int32>(ETileMapCompression::None) || Entry.DataSize == NumTiles;
+		if (!SizeValid || !DataInFile || !NameInFile || !CompressionValid || !UncompressedSizeValid)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FTileMapFile::CompressRLE(const TArray<uint8>& Data, TArray<uint8>& OutBytes)
+{
+	OutBytes.Reset();
+	for (int32 i = 0; i < Data.Num();)
+	{
+		const uint8 Tile = Data[i];
+		int32 RunLength = 1;
+		while (RunLength < MAX_uint8 && i + RunLength < Data.Num() && Data[i + RunLength] == Tile)
+		{
+			RunLength++;
+		}
+		OutBytes.Add(RunLength);
+		OutBytes.Add(Tile);
+		i += RunLength;
+	}
+}
+
+bool FTileMapFile::DecompressRLE(const uint8* Bytes, const int32 NumBytes, TArray<uint8>& OutData)
+{
+	if (NumBytes % 2 != 0)
+	{
+		return false;
+	}
+	int32 Position = 0;
+	for (int32 i = 0; i < NumBytes; i += 2)
+	{
+		const int32 RunLength = Bytes[i];
+		if (Position + RunLength > OutData.Num())
+		{
+			return false;
+		}
+		FMemory::Memset(OutData.GetData() + Position, Bytes[i + 1], RunLength);
+		Position += RunLength;
+	}
+	return Position == OutData.Num();
+}
@@ -45,6 +45,7 @@ void USLTilemapLib::SetTileAtXY(FTileMap& TileMap, const uint8 Tile, const int32
 {
 	const int32 TileIndex = TileMapXYToIndex(TileMap, X, Y);
 	TileMap.Data[TileIndex] = Tile;
+	TileMap.MarkDirty(X, Y, 1, 1);
 }
 
 uint8 USLTilemapLib::GetTileAtXY(const FTileMap& TileMap, const int32 X, const int32 Y)
@@ -54,26 +55,67 @@ uint8 USLTilemapLib::GetTileAtXY(const FTileMap& TileMap, const int32 X, const i
 
 UTexture2D* USLTilemapLib::TileMapToTexture(FTileMap& TileMap)
 {
-	TArray<FColor> Colors;
+	return UpdateTileMapTexture(TileMap, nullptr);
+}
+
+UTexture2D* USLTilemapLib::UpdateTileMapTexture(FTileMap& TileMap, UTexture2D* Texture)
+{
+	const FColor* TileColors = GetTileColorTable();
 	const int32 SizeX = TileMap.SizeX;
 	const int32 SizeY = TileMap.SizeY;
-	const int32 PixelCount = SizeX * SizeY;
-	for (const auto& Tile:TileMap.Data)
+
+	if (!Texture || Texture->GetSizeX() != SizeX || Texture->GetSizeY() != SizeY)
 	{
-		Colors.Add(TileToColor(Tile));
+		Texture = UTexture2D::CreateTransient(SizeX, SizeY, PF_B8G8R8A8, "");
+		FColor* Colors = static_cast<FColor*>(Texture->GetPlatformData()->Mips[0].BulkData.Lock(LOCK_READ_WRITE));
+		for (int32 i = 0; i < SizeX * SizeY; i++)
+		{
+			Colors[i] = TileColors[TileMap.Data[i]];
+		}
+		Texture->GetPlatformData()->Mips[0].BulkData.Unlock();
+		Texture->Filter = TF_Nearest;
+		Texture->UpdateResource();
+		TileMap.ClearDirty();
+		return Texture;
 	}
 
-	UTexture2D* Texture = UTexture2D::CreateTransient(SizeX, SizeY, PF_B8G8R8A8, "");
-	void* Data = Texture->GetPlatformData()->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
-	
-	FMemory::Memcpy(Data, Colors.GetData(), PixelCount * 4);
-	Texture->GetPlatformData()->Mips[0].BulkData.Unlock();
-	Texture->Filter = TF_Nearest;
-	Texture->UpdateResource();
-
+	UpdateTileMapTextureRegions(TileMap, Texture, TileMap.TakeDirtyRegions());
 	return Texture;
 }
 
+void USLTilemapLib::UpdateTileMapTextureRegions(const FTileMap& TileMap, UTexture2D* Texture, const TArray<FIntRect>& Regions)
+{
+	const FColor* TileColors = GetTileColorTable();
+	for (FIntRect Region : Regions)
+	{
+		Region.Clip(FIntRect(0, 0, TileMap.SizeX, TileMap.SizeY));
+		if (Region.Width() <= 0 || Region.Height() <= 0)
+		{
+			continue;
+		}
+
+		//The render thread reads the colors later, it frees them and the region once uploaded
+		const int32 RegionSizeX = Region.Width();
+		const int32 RegionSizeY = Region.Height();
+		FColor* Colors = new FColor[RegionSizeX * RegionSizeY];
+		for (int32 y = 0; y < RegionSizeY; y++)
+		{
+			const uint8* Tiles = &TileMap.Data[TileMapXYToIndex(TileMap, Region.Min.X, Region.Min.Y + y)];
+			for (int32 x = 0; x < RegionSizeX; x++)
+			{
+				Colors[y * RegionSizeX + x] = TileColors[Tiles[x]];
+			}
+		}
+		FUpdateTextureRegion2D* UpdateRegion = new FUpdateTextureRegion2D(Region.Min.X, Region.Min.Y, 0, 0, RegionSizeX, RegionSizeY);
+		Texture->UpdateTextureRegions(0, 1, UpdateRegion, RegionSizeX * sizeof(FColor), sizeof(FColor), reinterpret_cast<uint8*>(Colors),
+			[](uint8* SrcData, const FUpdateTextureRegion2D* UpdateRegions)
+			{
+				delete[] reinterpret_cast<FColor*>(SrcData);
+				delete UpdateRegions;
+			});
+	}
+}
+
 FColor USLTilemapLib::TileToColor(const uint8 Tile)
 {
 	const ETileState Flags = static_cast<ETileState>(Tile);
@@ -103,53 +145,221 @@ FColor USLTilemapLib::TileToColor(const uint8 Tile)
 	return FColor(R,G,B,A);
 }
 
+const FColor* USLTilemapLib::GetTileColorTable()
+{
+	struct FTileColorTable
+	{
+		FColor Colors[256];
+
+		FTileColorTable()
+		{
+			for (int32 Tile = 0; Tile < 256; Tile++)
+			{
+				Colors[Tile] = TileToColor(Tile);
+			}
+		}
+	};
+	static const FTileColorTable Table;
+	return Table.Colors;
+}
+
 
 FTileMap USLTilemapLib::MirrorTilemap(const FTileMap& TileMap)
 {
 	FTileMap OutTileMap = TileMap;
-	for (int32 y = 0; y < TileMap.SizeY; y++)
+	MirrorTilemapInPlace(OutTileMap);
+	return OutTileMap;
+}
+
+FTileMap USLTilemapLib::RotateTilemap(const FTileMap& TilemapToRotate)
+{
+	FTileMap OutTilemap = TilemapToRotate;
+	RotateTilemapInPlace(OutTilemap);
+	return OutTilemap;
+}
+
+bool USLTilemapLib::IsTilemapValid(const FTileMap& InTileTilemap)
+{
+	return InTileTilemap.Data.Num() == InTileTilemap.SizeX * InTileTilemap.SizeY;
+}
+
+FTileMap USLTilemapLib::GetTilemapSection(const FTileMap& Tilemap, const int32 x,
+                                          const int32 y, const int32 SizeX, const int32 SizeY)
+{
+	return CopyRegion(Tilemap, x, y, SizeX, SizeY);
+}
+
+FTileMap USLTilemapLib::CopyRegion(const FTileMap& TileMap, const int32 X, const int32 Y, const int32 RegionSizeX, const int32 RegionSizeY)
+{
+	FTileMap OutRegion = FTileMap(FMath::Max(RegionSizeX, 0), FMath::Max(RegionSizeY, 0));
+	PasteRegion(OutRegion, TileMap, -X, -Y);
+	return OutRegion;
+}
+
+void USLTilemapLib::PasteRegion(FTileMap& TileMap, const FTileMap& Source, const int32 X, const int32 Y, const bool bSkipNone)
+{
+	const FIntRect Region = ClipToTileMap(TileMap, X, Y, Source.SizeX, Source.SizeY);
+	if (Region.Width() <= 0 || Region.Height() <= 0)
+	{
+		return;
+	}
+	const int32 RegionSizeX = Region.Width();
+	for (int32 y = Region.Min.Y; y < Region.Max.Y; y++)
 	{
-		for (int32 x = 0; x < TileMap.SizeX; x++)
+		const uint8* SourceRow = &Source.Data[TileMapXYToIndex(Source, Region.Min.X - X, y - Y)];
+		uint8* Row = &TileMap.Data[TileMapXYToIndex(TileMap, Region.Min.X, y)];
+		if (!bSkipNone)
+		{
+			FMemory::Memcpy(Row, SourceRow, RegionSizeX);
+			continue;
+		}
+		//Branch free so the compiler can vectorize it
+		for (int32 x = 0; x < RegionSizeX; x++)
 		{
-			SetTileAtXY(OutTileMap, GetTileAtXY(TileMap, TileMap.SizeX - 1 - x, y), x, y);
+			Row[x] = SourceRow[x] ? SourceRow[x] : Row[x];
 		}
 	}
-	return OutTileMap;
+	TileMap.MarkDirty(Region.Min.X, Region.Min.Y, RegionSizeX, Region.Height());
 }
 
-FTileMap USLTilemapLib::RotateTilemap(const FTileMap& TilemapToRotate)
+void USLTilemapLib::FillRegion(FTileMap& TileMap, const uint8 Tile, const int32 X, const int32 Y, const int32 RegionSizeX, const int32 RegionSizeY)
 {
-	FTileMap OutTilemap = TilemapToRotate;
-	OutTilemap.SizeY = TilemapToRotate.SizeX;
-	OutTilemap.SizeX = TilemapToRotate.SizeY;
+	const FIntRect Region = ClipToTileMap(TileMap, X, Y, RegionSizeX, RegionSizeY);
+	if (Region.Width() <= 0 || Region.Height() <= 0)
+	{
+		return;
+	}
+	for (int32 y = Region.Min.Y; y < Region.Max.Y; y++)
+	{
+		FMemory::Memset(&TileMap.Data[TileMapXYToIndex(TileMap, Region.Min.X, y)], Tile, Region.Width());
+	}
+	TileMap.MarkDirty(Region.Min.X, Region.Min.Y, Region.Width(), Region.Height());
+}
 
-	for (int32 y = 0; y < OutTilemap.SizeY; y++)
+int32 USLTilemapLib::FloodFill(FTileMap& TileMap, const uint8 Tile, const int32 X, const int32 Y)
+{
+	if (X < 0 || Y < 0 || X >= TileMap.SizeX || Y >= TileMap.SizeY)
 	{
-		for (int32 x = 0; x < OutTilemap.SizeX; x++)
+		return 0;
+	}
+	const uint8 TileToReplace = GetTileAtXY(TileMap, X, Y);
+	if (TileToReplace == Tile)
+	{
+		return 0;
+	}
+
+	//Scanline fill, each seed fills its whole run in one row and seeds one tile per matching run above and below
+	uint8* Tiles = TileMap.Data.GetData();
+	const int32 SizeX = TileMap.SizeX;
+	const int32 SizeY = TileMap.SizeY;
+	int32 NumFilled = 0;
+	FIntRect Filled(X, Y, X + 1, Y + 1);
+	TArray<FIntPoint> Seeds;
+	Seeds.Add(FIntPoint(X, Y));
+	while (Seeds.Num() > 0)
+	{
+		const FIntPoint Seed = Seeds.Pop(false);
+		uint8* Row = Tiles + Seed.Y * SizeX;
+		if (Row[Seed.X] != TileToReplace)
+		{
+			continue;
+		}
+		int32 MinX = Seed.X;
+		int32 MaxX = Seed.X + 1;
+		while (MinX > 0 && Row[MinX - 1] == TileToReplace)
+		{
+			MinX--;
+		}
+		while (MaxX < SizeX && Row[MaxX] == TileToReplace)
+		{
+			MaxX++;
+		}
+		FMemory::Memset(Row + MinX, Tile, MaxX - MinX);
+		NumFilled += MaxX - MinX;
+		Filled.Union(FIntRect(MinX, Seed.Y, MaxX, Seed.Y + 1));
+
+		for (const int32 NeighborY : {Seed.Y - 1, Seed.Y + 1})
 		{
-			SetTileAtXY(OutTilemap, GetTileAtXY(TilemapToRotate, y, TilemapToRotate.SizeY - 1 - x), x, y);
+			if (NeighborY < 0 || NeighborY >= SizeY)
+			{
+				continue;
+			}
+			const uint8* NeighborRow = Tiles + NeighborY * SizeX;
+			for (int32 x = MinX; x < MaxX; x++)
+			{
+				if (NeighborRow[x] == TileToReplace && (x == MinX || NeighborRow[x - 1] != TileToReplace))
+				{
+					Seeds.Add(FIntPoint(x, NeighborY));
+				}
+			}
 		}
 	}
-	return OutTilemap;
+	TileMap.MarkDirty(Filled.Min.X, Filled.Min.Y, Filled.Width(), Filled.Height());
+	return NumFilled;
 }
 
-bool USLTilemapLib::IsTilemapValid(const FTileMap& InTileTilemap)
+void USLTilemapLib::MirrorTilemapInPlace(FTileMap& TileMap)
 {
-	return InTileTilemap.Data.Num() == InTileTilemap.SizeX * InTileTilemap.SizeY;
+	for (int32 y = 0; y < TileMap.SizeY; y++)
+	{
+		uint8* Row = &TileMap.Data[TileMapXYToIndex(TileMap, 0, y)];
+		for (int32 x = 0; x < TileMap.SizeX / 2; x++)
+		{
+			Swap(Row[x], Row[TileMap.SizeX - 1 - x]);
+		}
+	}
+	TileMap.MarkAllDirty();
 }
 
-FTileMap USLTilemapLib::GetTilemapSection(const FTileMap& Tilemap, const int32 x,
-                                          const int32 y, const int32 SizeX, const int32 SizeY)
+void USLTilemapLib::RotateTilemapInPlace(FTileMap& TileMap)
 {
-	FTileMap OutSection = FTileMap(SizeX, SizeY);
+	//Each tile of the top left quadrant starts a cycle of four tiles a quarter turn apart, the center of odd sizes stays put
+	if (TileMap.SizeX == TileMap.SizeY)
+	{
+		const int32 Size = TileMap.SizeX;
+		uint8* Tiles = TileMap.Data.GetData();
+		for (int32 y = 0; y < Size / 2; y++)
+		{
+			for (int32 x = 0; x < (Size + 1) / 2; x++)
+			{
+				uint8& Tile0 = Tiles[y * Size + x];
+				uint8& Tile1 = Tiles[x * Size + Size - 1 - y];
+				uint8& Tile2 = Tiles[(Size - 1 - y) * Size + Size - 1 - x];
+				uint8& Tile3 = Tiles[(Size - 1 - x) * Size + y];
+				const uint8 Last = Tile3;
+				Tile3 = Tile2;
+				Tile2 = Tile1;
+				Tile1 = Tile0;
+				Tile0 = Last;
+			}
+		}
+		TileMap.MarkAllDirty();
+		return;
+	}
 
-	for (int32 j = 0; j < SizeY; j++)
+	//Input rows become output columns, written from the last column back
+	const int32 InSizeX = TileMap.SizeX;
+	const int32 InSizeY = TileMap.SizeY;
+	TArray<uint8> Rotated;
+	Rotated.SetNumUninitialized(InSizeX * InSizeY);
+	for (int32 InY = 0; InY < InSizeY; InY++)
 	{
-		for (int32 i = 0; i < SizeX; i++)
+		const uint8* InRow = &TileMap.Data[TileMapXYToIndex(TileMap, 0, InY)];
+		uint8* OutColumn = Rotated.GetData() + InSizeY - 1 - InY;
+		for (int32 InX = 0; InX < InSizeX; InX++)
 		{
-			const int32 temp = GetTileAtXY(Tilemap, x + i, y + j);
-			SetTileAtXY(OutSection, temp, i, j);
+			OutColumn[InX * InSizeY] = InRow[InX];
 		}
 	}
-	return OutSection;
+	TileMap.SizeX = InSizeY;
+	TileMap.SizeY = InSizeX;
+	TileMap.Data = MoveTemp(Rotated);
+	TileMap.MarkAllDirty();
+}
+
+FIntRect USLTilemapLib::ClipToTileMap(const FTileMap& TileMap, const int32 X, const int32 Y, const int32 RegionSizeX, const int32 RegionSizeY)
+{
+	FIntRect Region(X, Y, X + RegionSizeX, Y + RegionSizeY);
+	Region.Clip(FIntRect(0, 0, TileMap.SizeX, TileMap.SizeY));
+	return Region;
 }
@@ -0,0 +1,297 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SLTilemapMeshComponent.h"
+#include "SLTilemapSubsystem.h"
+#include "Async/Async.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+
+
+USLTilemapMeshComponent::USLTilemapMeshComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+void USLTilemapMeshComponent::BeginPlay()
+{
+	Super::BeginPlay();
+	if (!bFollowTilemapSubsystem)
+	{
+		return;
+	}
+	if (USLTilemapSubsystem* Subsystem = GetWorld()->GetSubsystem<USLTilemapSubsystem>())
+	{
+		Subsystem->OnTilemapChanged.AddDynamic(this, &USLTilemapMeshComponent::UpdateTileMapRegions);
+		SetTileMap(Subsystem->OutputTileMap);
+	}
+}
+
+void USLTilemapMeshComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (USLTilemapSubsystem* Subsystem = GetWorld()->GetSubsystem<USLTilemapSubsystem>())
+	{
+		Subsystem->OnTilemapChanged.RemoveDynamic(this, &USLTilemapMeshComponent::UpdateTileMapRegions);
+	}
+	//The build only reads its own copy of the tiles, finish it so its results aren't left behind
+	if (BuildTask.IsValid())
+	{
+		BuildTask.Wait();
+		BuildTask.Reset();
+	}
+	DestroyComponents();
+	Super::EndPlay(EndPlayReason);
+}
+
+void USLTilemapMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	if (BuildTask.IsValid() && BuildTask.IsReady())
+	{
+		if (!DiscardBuild)
+		{
+			ApplyBuild(BuildTask.Get());
+		}
+		DiscardBuild = false;
+		BuildTask.Reset();
+	}
+	if (!BuildTask.IsValid() && DirtyChunks.Num() > 0)
+	{
+		StartBuild();
+	}
+}
+
+void USLTilemapMeshComponent::SetTileMap(const FTileMap& NewTileMap)
+{
+	if (!USLTilemapLib::IsTilemapValid(NewTileMap))
+	{
+		return;
+	}
+	if (NewTileMap.SizeX != TileMap.SizeX || NewTileMap.SizeY != TileMap.SizeY)
+	{
+		TileMap = NewTileMap;
+		RebuildAll();
+		return;
+	}
+
+	//Comparing rows is far cheaper than rebuilding a chunk that didn't change
+	for (int32 ChunkY = 0; ChunkY * ChunkSize < TileMap.SizeY; ChunkY++)
+	{
+		for (int32 ChunkX = 0; ChunkX * ChunkSize < TileMap.SizeX; ChunkX++)
+		{
+			const FIntRect Region(ChunkX * ChunkSize, ChunkY * ChunkSize, FMath::Min((ChunkX + 1) * ChunkSize, TileMap.SizeX), FMath::Min((ChunkY + 1) * ChunkSize, TileMap.SizeY));
+			for (int32 y = Region.Min.Y; y < Region.Max.Y; y++)
+			{
+				const int32 RowStart = USLTilemapLib::TileMapXYToIndex(TileMap, Region.Min.X, y);
+				if (FMemory::Memcmp(&TileMap.Data[RowStart], &NewTileMap.Data[RowStart], Region.Width()) != 0)
+				{
+					DirtyChunks.Add(FIntPoint(ChunkX, ChunkY));
+					break;
+				}
+			}
+		}
+	}
+	TileMap.Data = NewTileMap.Data;
+}
+
+void USLTilemapMeshComponent::UpdateTileMapRegions(const FTileMap& NewTileMap, const TArray<FTileMapRegion>& Regions)
+{
+	if (!USLTilemapLib::IsTilemapValid(NewTileMap))
+	{
+		return;
+	}
+	if (NewTileMap.SizeX != TileMap.SizeX || NewTileMap.SizeY != TileMap.SizeY)
+	{
+		TileMap = NewTileMap;
+		RebuildAll();
+		return;
+	}
+	//Both maps are the same size, so each row of a region is one copy at the same index
+	for (const FTileMapRegion& Region : Regions)
+	{
+		FIntRect Rect(Region.X, Region.Y, Region.X + Region.SizeX, Region.Y + Region.SizeY);
+		Rect.Clip(FIntRect(0, 0, TileMap.SizeX, TileMap.SizeY));
+		if (Rect.Width() <= 0 || Rect.Height() <= 0)
+		{
+			continue;
+		}
+		for (int32 Y = Rect.Min.Y; Y < Rect.Max.Y; Y++)
+		{
+			const int32 Index = USLTilemapLib::TileMapXYToIndex(TileMap, Rect.Min.X, Y);
+			FMemory::Memcpy(&TileMap.Data[Index], &NewTileMap.Data[Index], Rect.Width());
+		}
+		MarkChunksDirty(Rect);
+	}
+}
+
+void USLTilemapMeshComponent::RebuildAll()
+{
+	//A build in flight may be for chunks that no longer exist
+	DiscardBuild = BuildTask.IsValid();
+	DestroyComponents();
+	MarkChunksDirty(FIntRect(0, 0, TileMap.SizeX, TileMap.SizeY));
+}
+
+bool USLTilemapMeshComponent::IsBuilding() const
+{
+	return BuildTask.IsValid() || DirtyChunks.Num() > 0;
+}
+
+void USLTilemapMeshComponent::MarkChunksDirty(const FIntRect& Region)
+{
+	FIntRect Clipped = Region;
+	Clipped.Clip(FIntRect(0, 0, TileMap.SizeX, TileMap.SizeY));
+	if (Clipped.Width() <= 0 || Clipped.Height() <= 0)
+	{
+		return;
+	}
+	for (int32 ChunkY = Clipped.Min.Y / ChunkSize; ChunkY <= (Clipped.Max.Y - 1) / ChunkSize; ChunkY++)
+	{
+		for (int32 ChunkX = Clipped.Min.X / ChunkSize; ChunkX <= (Clipped.Max.X - 1) / ChunkSize; ChunkX++)
+		{
+			DirtyChunks.Add(FIntPoint(ChunkX, ChunkY));
+		}
+	}
+}
+
+void USLTilemapMeshComponent::StartBuild()
+{
+	TArray<FIntPoint> ChunksToBuild = DirtyChunks.Array();
+	DirtyChunks.Reset();
+	BuildTask = Async(EAsyncExecution::ThreadPool, [Tiles = TileMap, ChunksToBuild, InChunkSize = ChunkSize, InTileSize = TileSize]()
+	{
+		TArray<FChunkInstances> Builds;
+		Builds.SetNum(ChunksToBuild.Num());
+		for (int32 i = 0; i < ChunksToBuild.Num(); i++)
+		{
+			Builds[i].Chunk = ChunksToBuild[i];
+			BuildChunk(Tiles, InChunkSize, InTileSize, Builds[i]);
+		}
+		return Builds;
+	});
+}
+
+void USLTilemapMeshComponent::ApplyBuild(const TArray<FChunkInstances>& Builds)
+{
+	for (const FChunkInstances& Build : Builds)
+	{
+		ChunkTransforms.Add(Build.Chunk, Build);
+	}
+	StateComponents.SetNum(NumTileStates);
+	for (int32 StateIndex = 0; StateIndex < NumTileStates; StateIndex++)
+	{
+		UStaticMesh* Mesh = TileMeshes.FindRef(static_cast<ETileState>(1 << StateIndex));
+		if (!Mesh)
+		{
+			continue;
+		}
+		bool bFitsRanges = StateComponents[StateIndex] != nullptr;
+		for (int32 i = 0; i < Builds.Num() && bFitsRanges; i++)
+		{
+			const FInstanceRange* Range = ChunkRanges[StateIndex].Find(Builds[i].Chunk);
+			bFitsRanges = Range && Builds[i].Transforms[StateIndex].Num() <= Range->Capacity;
+		}
+		if (!bFitsRanges)
+		{
+			LayoutState(StateIndex, Mesh);
+			continue;
+		}
+
+		//Every changed chunk still fits in its range, rewrite only those instances
+		UHierarchicalInstancedStaticMeshComponent* Component = StateComponents[StateIndex];
+		for (const FChunkInstances& Build : Builds)
+		{
+			const FInstanceRange& Range = ChunkRanges[StateIndex][Build.Chunk];
+			if (Range.Capacity == 0)
+			{
+				continue;
+			}
+			TArray<FTransform> RangeTransforms = Build.Transforms[StateIndex];
+			RangeTransforms.Reserve(Range.Capacity);
+			while (RangeTransforms.Num() < Range.Capacity)
+			{
+				RangeTransforms.Add(GetHiddenTransform(Build.Chunk));
+			}
+			Component->BatchUpdateInstancesTransforms(Range.Start, RangeTransforms, false, true);
+		}
+	}
+}
+
+void USLTilemapMeshComponent::LayoutState(const int32 StateIndex, UStaticMesh* Mesh)
+{
+	UHierarchicalInstancedStaticMeshComponent*& Component = StateComponents[StateIndex];
+	if (!Component)
+	{
+		Component = NewObject<UHierarchicalInstancedStaticMeshComponent>(GetOwner());
+		Component->SetupAttachment(this);
+		Component->RegisterComponent();
+	}
+	Component->SetStaticMesh(Mesh);
+
+	//Spare instances let a chunk gain tiles of this state without laying the whole component out again
+	TArray<FTransform> Transforms;
+	TMap<FIntPoint, FInstanceRange>& Ranges = ChunkRanges[StateIndex];
+	Ranges.Reset();
+	for (const auto& Pair : ChunkTransforms)
+	{
+		const TArray<FTransform>& ChunkStateTransforms = Pair.Value.Transforms[StateIndex];
+		FInstanceRange& Range = Ranges.Add(Pair.Key);
+		Range.Start = Transforms.Num();
+		Range.Capacity = FMath::Min(ChunkStateTransforms.Num() + ChunkStateTransforms.Num() / 4 + 8, ChunkSize * ChunkSize);
+		Transforms.Append(ChunkStateTransforms);
+		while (Transforms.Num() < Range.Start + Range.Capacity)
+		{
+			Transforms.Add(GetHiddenTransform(Pair.Key));
+		}
+	}
+	Component->ClearInstances();
+	Component->AddInstances(Transforms, false);
+}
+
+void USLTilemapMeshComponent::DestroyComponents()
+{
+	for (UHierarchicalInstancedStaticMeshComponent* Component : StateComponents)
+	{
+		if (Component)
+		{
+			Component->DestroyComponent();
+		}
+	}
+	StateComponents.Reset();
+	for (TMap<FIntPoint, FInstanceRange>& Ranges : ChunkRanges)
+	{
+		Ranges.Reset();
+	}
+	ChunkTransforms.Reset();
+}
+
+FTransform USLTilemapMeshComponent::GetHiddenTransform(const FIntPoint& Chunk) const
+{
+	//Zero scale at the chunk's centre, so spare instances draw nothing and don't grow the cluster bounds
+	const FVector Location((Chunk.X + 0.5f) * ChunkSize * TileSize, (Chunk.Y + 0.5f) * ChunkSize * TileSize, 0);
+	return FTransform(FQuat::Identity, Location, FVector::ZeroVector);
+}
+
+void USLTilemapMeshComponent::BuildChunk(const FTileMap& Tiles, const int32 InChunkSize, const float InTileSize, FChunkInstances& OutInstances)
+{
+	const int32 MinX = OutInstances.Chunk.X * InChunkSize;
+	const int32 MinY = OutInstances.Chunk.Y * InChunkSize;
+	const int32 MaxX = FMath::Min(MinX + InChunkSize, Tiles.SizeX);
+	const int32 MaxY = FMath::Min(MinY + InChunkSize, Tiles.SizeY);
+	for (int32 y = MinY; y < MaxY; y++)
+	{
+		const uint8* Row = &Tiles.Data[USLTilemapLib::TileMapXYToIndex(Tiles, 0, y)];
+		for (int32 x = MinX; x < MaxX; x++)
+		{
+			//Only solved tiles, which have exactly one state
+			const uint8 Tile = Row[x];
+			if (Tile == 0 || !FMath::IsPowerOfTwo(Tile))
+			{
+				continue;
+			}
+			const FVector Location((x + 0.5f) * InTileSize, (y + 0.5f) * InTileSize, 0);
+			OutInstances.Transforms[FMath::FloorLog2(Tile)].Add(FTransform(Location));
+		}
+	}
+}
@@ -2,13 +2,150 @@
 
 
 #include "SLTilemapSubsystem.h"
+#include "Async/Async.h"
+#include "Engine/Texture2D.h"
 
 
 void USLTilemapSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 {
+	Super::Initialize(Collection);
 	Wave = NewObject<USLWave>();
 }
 
 void USLTilemapSubsystem::Deinitialize()
 {
+	CancelGeneration();
+	if (GenerationTask.IsValid())
+	{
+		GenerationTask.Wait();
+	}
+	Super::Deinitialize();
+}
+
+void USLTilemapSubsystem::Tick(float DeltaTime)
+{
+	if (!Generating)
+	{
+		ReportWaveChanges();
+	}
+	if (!OutputTileMap.IsDirty())
+	{
+		return;
+	}
+
+	//Edits made by listeners are reported next frame
+	const TArray<FIntRect> DirtyRegions = OutputTileMap.TakeDirtyRegions();
+	if (OutputTexture)
+	{
+		if (OutputTexture->GetSizeX() == OutputTileMap.SizeX && OutputTexture->GetSizeY() == OutputTileMap.SizeY)
+		{
+			USLTilemapLib::UpdateTileMapTextureRegions(OutputTileMap, OutputTexture, DirtyRegions);
+		}
+		else
+		{
+			OutputTexture = USLTilemapLib::TileMapToTexture(OutputTileMap);
+		}
+	}
+	TArray<FTileMapRegion> Regions;
+	for (const FIntRect& DirtyRegion : DirtyRegions)
+	{
+		Regions.Add(FTileMapRegion(DirtyRegion));
+	}
+	OnTilemapChanged.Broadcast(OutputTileMap, Regions);
+}
+
+TStatId USLTilemapSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USLTilemapSubsystem, STATGROUP_Tickables);
+}
+
+bool USLTilemapSubsystem::GenerateAsync(const FTileMap& NewInputTileMap, const FTileMap& NewOutputTileMap, const int32 Seed, const int32 NumRuns)
+{
+	if (Generating)
+	{
+		return false;
+	}
+	Generating = true;
+	InputTileMap = NewInputTileMap;
+	Wave->InputTileMap = NewInputTileMap;
+	Wave->OutputTileMap = NewOutputTileMap;
+	Wave->Seed = Seed;
+	Wave->PrepareSpeculativeRuns(NumRuns);
+	//A cancel that came after the last run reset the flag but before OnGenerationFinished must not stop this one,
+	//cleared here rather than in the task so CancelGeneration right after this call still applies
+	Wave->ClearCancel();
+
+	USLWave* TaskWave = Wave;
+	TWeakObjectPtr<USLTilemapSubsystem> WeakThis(this);
+	GenerationTask = Async(EAsyncExecution::ThreadPool, [TaskWave, NumRuns, WeakThis]()
+	{
+		const bool bSuccess = TaskWave->RunSpeculative(NumRuns);
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, bSuccess]()
+		{
+			if (WeakThis.IsValid())
+			{
+				WeakThis->OnGenerationFinished(bSuccess);
+			}
+		});
+	});
+	return true;
+}
+
+void USLTilemapSubsystem::CancelGeneration()
+{
+	if (Generating)
+	{
+		Wave->Cancel();
+	}
+}
+
+bool USLTilemapSubsystem::IsGenerating() const
+{
+	return Generating;
+}
+
+float USLTilemapSubsystem::GetGenerationProgress() const
+{
+	return Generating ? Wave->GetProgress() : 0;
+}
+
+UTexture2D* USLTilemapSubsystem::GetOutputTexture()
+{
+	if (!OutputTexture)
+	{
+		//Creating the texture must not swallow the regions OnTilemapChanged is about to report
+		TArray<FIntRect> DirtyRegions = OutputTileMap.DirtyRegions;
+		const bool bAllDirty = OutputTileMap.bAllDirty;
+		OutputTexture = USLTilemapLib::TileMapToTexture(OutputTileMap);
+		OutputTileMap.DirtyRegions = MoveTemp(DirtyRegions);
+		OutputTileMap.bAllDirty = bAllDirty;
+	}
+	return OutputTexture;
+}
+
+void USLTilemapSubsystem::OnGenerationFinished(const bool bSuccess)
+{
+	Generating = false;
+	if (bSuccess)
+	{
+		OutputTileMap = Wave->OutputTileMap;
+		OutputTileMap.MarkAllDirty();
+	}
+	Wave->OutputTileMap.ClearDirty();
+	OnTilemapGenerated.Broadcast(bSuccess, Wave->OutputTileMap);
+}
+
+void USLTilemapSubsystem::ReportWaveChanges()
+{
+	FTileMap& WaveTileMap = Wave->OutputTileMap;
+	if (!WaveTileMap.IsDirty())
+	{
+		return;
+	}
+	TArray<FTileMapRegion> Regions;
+	for (const FIntRect& DirtyRegion : WaveTileMap.TakeDirtyRegions())
+	{
+		Regions.Add(FTileMapRegion(DirtyRegion));
+	}
+	OnWaveChanged.Broadcast(WaveTileMap, Regions);
 }
@@ -2,355 +2,978 @@
 
 
 #include "SLWave.h"
+#include "SLTilemap.h"
+#include "Async/ParallelFor.h"
+#include "Templates/IntegralConstant.h"
+#include <atomic>
+
+
+namespace
+{
+	//Propagator directions, Left, Down, Right, Up
+	constexpr int32 NumDirections = 4;
+	constexpr int32 DirectionX[NumDirections] = {-1, 0, 1, 0};
+	constexpr int32 DirectionY[NumDirections] = {0, 1, 0, -1};
+	constexpr int32 OppositeDirection[NumDirections] = {2, 3, 0, 1};
+
+	//Count * log2(Count) is kept in steps of 1 / WeightLogWeightScale, any sum of them up to 2^33 is then exact in a double
+	constexpr double WeightLogWeightScale = 1 << 20;
+
+	const FIntRect NoPendingDirtyRect(MAX_int32, MAX_int32, MIN_int32, MIN_int32);
+
+	//Entropy from the running sums, with weights w = Count, H = log(Sum w) - Sum(w log w) / Sum w
+	float GetEntropy(const int32 SumWeights, const double SumWeightLogWeights)
+	{
+		return log2(static_cast<double>(SumWeights)) - SumWeightLogWeights / SumWeights;
+	}
+
+	//Calls Function with PatternSize as a TIntegralConstant, so the solver loops below it are compiled per size and call TPattern directly
+	template <typename FunctionType>
+	auto DispatchPatternSize(const int32 PatternSize, FunctionType&& Function)
+	{
+		static_assert(SL_MIN_PATTERN_SIZE == 2 && SL_MAX_PATTERN_SIZE == 4, "Every pattern size needs a case");
+		switch (PatternSize)
+		{
+		case 2:
+			return Function(TIntegralConstant<int32, 2>());
+		case 3:
+			return Function(TIntegralConstant<int32, 3>());
+		default:
+			check(PatternSize == 4);
+			return Function(TIntegralConstant<int32, 4>());
+		}
+	}
+}
 
 
 bool USLWave::Initialize()
 {
 	const double StartTime = FPlatformTime::Seconds();
-	if (!(USLTilemapLib::IsTilemapValid(OutputTileMap) && USLTilemapLib::IsTilemapValid(InputTileMap)))
+	if (!CanSolve())
+	{
+		return false;
+	}
+	Failed = false;
+	FailedAtIndex = 0;
+	ObservedCellCount.Reset();
+	TotalCellCount.Reset();
+	Stats = FWaveStats();
+	if (!HasModelForInput())
+	{
+		GeneratePatterns();
+		Stats.GeneratePatternsMs = 1000 * (FPlatformTime::Seconds() - StartTime);
+	}
+	if (Model->NumPatterns == 0)
 	{
 		return false;
 	}
-	GeneratePatterns();
+	if (Model->NumPatterns > MAX_uint16)
+	{
+		UE_LOG(LogSLTilemap, Warning, TEXT("%d patterns is more than the solver supports"), Model->NumPatterns);
+		return false;
+	}
 	InitPatternCells();
-	for (int32 i = 0; i < CellArray.Num(); i++)
+	DispatchPatternSize(Model->PatternSize, [this](auto Size)
 	{
-		UpdateCell(i);
-		if (Failed)
-		{
-			OnFailed();
-			break;
-		}
+		BanUnfitPatterns<decltype(Size)::Value>();
+	});
+	if (Failed)
+	{
+		OnFailed();
 	}
+
+	//Backtracking never returns past the initial state
+	BanJournal.Reset();
+	NextBanToPropagate = 0;
+	MapWriteJournal.Reset();
 	const double EndTime = FPlatformTime::Seconds();
 	const double TotalTimems = 1000 * (EndTime - StartTime);
-	UE_LOG(LogTemp, Warning, TEXT("Initialization took %f ms"), TotalTimems);
-	UE_LOG(LogTemp, Warning, TEXT("There are %d cells"), CellArray.Num());
-	UE_LOG(LogTemp, Warning, TEXT("There are %d patterns"), Patterns.Num());
+	Stats.InitializeMs = TotalTimems;
+	Stats.NumPatterns = Model->NumPatterns;
+	Stats.NumCells = CellXArray.Num();
+	UE_LOG(LogSLTilemap, Log, TEXT("Initialization took %f ms"), TotalTimems);
+	UE_LOG(LogSLTilemap, Log, TEXT("There are %d cells"), CellXArray.Num());
+	UE_LOG(LogSLTilemap, Log, TEXT("There are %d patterns"), Model->NumPatterns);
+	return true;
+}
 
-	for (int32 i = 0; i< Patterns.Num(); i++)
+bool USLWave::PrepareModel()
+{
+	if (!CanSolve())
 	{
-		//UE_LOG(LogTemp, Warning, TEXT("Pattern %d has count %d, probability %f, and PlogP %f"), i, Counts[i], Probabilities[i], PlogP[i]);
+		return false;
+	}
+	if (!HasModelForInput())
+	{
+		GeneratePatterns();
 	}
-
 	return true;
 }
 
 bool USLWave::Step()
 {
-	const double StartTime = FPlatformTime::Seconds();
-	//Find unobserved PatternCell with lowest entropy
-	int32 CellToObserve = -1;
-	float LowestEntropy = BIG_NUMBER;
-	for (int32 i = 0; i < CellArray.Num(); i++)
+	if (Failed || !Model.IsValid())
 	{
-		if (!CellIsObservedArray[i] && CellEntropyArray[i] < LowestEntropy)
-		{
-			LowestEntropy = CellEntropyArray[i];
-			CellToObserve = i;
-		}
+		return false;
 	}
+	return DispatchPatternSize(Model->PatternSize, [this](auto Size)
+	{
+		return StepWithPatternSize<decltype(Size)::Value>();
+	});
+}
 
-	//Check for no unobserved cells found
-	if (CellToObserve == -1)
+bool USLWave::Run()
+{
+	const bool Initialized = Initialize();
+	while (Initialized && !CancelRequested && Step())
 	{
-		UE_LOG(LogTemp, Warning, TEXT("No unobserved cell was found"));
-		return false;
+
 	}
+	//A cancel stops the current or next Run and is then cleared
+	const bool Cancelled = CancelRequested.AtomicSet(false);
+	return Initialized && !Failed && !Cancelled;
+}
 
-	//Check for bad cell found during search
-	if (CellArray[CellToObserve].AllowedPatternIndices.Num() < 1)
+bool USLWave::RunSpeculative(const int32 NumRuns)
+{
+	if (NumRuns < 2)
+	{
+		return Run();
+	}
+	if (!PrepareModel())
 	{
-		//UE_LOG(LogTemp, Warning, TEXT("Cell at %d, %d has bad entropy %f and was found during lowest entropy search"), CellXArray[CellToObserve], CellYArray[CellToObserve], CellEntropyArray[CellToObserve]);
-		check(false);
 		return false;
 	}
+	//Waves are UObjects, off the game thread they must have been created by PrepareSpeculativeRuns already
+	if (IsInGameThread())
+	{
+		PrepareSpeculativeRuns(NumRuns);
+	}
+	check(SpeculativeWaves.Num() >= NumRuns - 1);
+	const FTileMap StartTileMap = OutputTileMap;
 
-	//Observe Pattern cell with lowest entropy if found and propegate
-
-	UE_LOG(LogTemp, Warning, TEXT("Observing cell at %d,%d and it has entropy %f"), CellXArray[CellToObserve], CellYArray[CellToObserve], CellEntropyArray[CellToObserve]);
-	ObserveCell(CellToObserve);
-
-	//Enqueue unobserved neighbors
-	TQueue<int32> CellsToUpdate;
-	for (int32 i = 0; i < CellArray[CellToObserve].NeighborIndices.Num(); i++)
+	//Every run starts from the same OutputTileMap and shares this wave's pattern tables
+	TArray<USLWave*> Waves;
+	Waves.Add(this);
+	for (int32 i = 0; i < NumRuns - 1; i++)
 	{
-		const int32 NeighborIndex = CellArray[CellToObserve].NeighborIndices[i];
-		if (!CellIsObservedArray[NeighborIndex])
-		{
-			CellsToUpdate.Enqueue(NeighborIndex);
-		}
+		USLWave* SpeculativeWave = SpeculativeWaves[i];
+		SpeculativeWave->InputTileMap = InputTileMap;
+		SpeculativeWave->OutputTileMap = OutputTileMap;
+		SpeculativeWave->Seed = Seed + i + 1;
+		SpeculativeWave->PatternSize = PatternSize;
+		SpeculativeWave->Symmetry = Symmetry;
+		SpeculativeWave->MaxBacktracks = MaxBacktracks;
+		SpeculativeWave->Model = Model;
+		SpeculativeWave->ObservedCellCount.Reset();
+		SpeculativeWave->TotalCellCount.Reset();
+		Waves.Add(SpeculativeWave);
 	}
+	ActiveSpeculativeRuns.Set(NumRuns - 1);
 
-	//Update Cells in queue, enquing their unobserved neighbors if cell changes
-	while (!CellsToUpdate.IsEmpty())
+	std::atomic<int32> WinningRun(INDEX_NONE);
+	ParallelFor(NumRuns, [this, &Waves, &WinningRun](const int32 RunIndex)
 	{
-		//Get next cell in queue
-		int32 ThisCellIndex;
-		CellsToUpdate.Dequeue(ThisCellIndex);
-		//Update cell, enquing neighbors if cell changed
-		const bool CellChanged = UpdateCell(ThisCellIndex);
-		if (Failed)
+		USLWave* RunWave = Waves[RunIndex];
+		if (!RunWave->Initialize())
 		{
-			OnFailed();
-			break;
+			return;
 		}
-		if (CellChanged)
+		bool Finished = false;
+		while (WinningRun.load() == INDEX_NONE && !CancelRequested)
 		{
-			//Update Map Data with new cell state
-			const FTileMap CombinedPatterns = OrCellPatternsTogether(ThisCellIndex);
-			WritePatternToMapData(CombinedPatterns, CellXArray[ThisCellIndex], CellYArray[ThisCellIndex]);
-			//Enqueue unobserved neighbors
-			for (int32 i = 0; i < CellArray[ThisCellIndex].NeighborIndices.Num(); i++)
+			if (!RunWave->Step())
 			{
-				const int32 NeighborIndex = CellArray[ThisCellIndex].NeighborIndices[i];
-				if (!CellIsObservedArray[NeighborIndex])
-				{
-					CellsToUpdate.Enqueue(NeighborIndex);
-				}
+				Finished = !RunWave->Failed;
+				break;
 			}
 		}
+		int32 NoWinner = INDEX_NONE;
+		if (Finished)
+		{
+			WinningRun.compare_exchange_strong(NoWinner, RunIndex);
+		}
+	});
+
+	ActiveSpeculativeRuns.Reset();
+	const int32 Winner = WinningRun.load();
+	const bool Cancelled = CancelRequested.AtomicSet(false);
+	if (Winner == INDEX_NONE)
+	{
+		//This wave's own run may have stopped halfway, leave it as it was before
+		OutputTileMap = StartTileMap;
+		OutputTileMap.MarkAllDirty();
+		Failed = true;
+		UE_LOG(LogSLTilemap, Warning, TEXT("No speculative run of %d succeeded%s"), NumRuns, Cancelled ? TEXT(", cancelled") : TEXT(""));
+		return false;
 	}
-	const double EndTime = FPlatformTime::Seconds();
-	const double TotalTimems = 1000 * (EndTime - StartTime);
-	UE_LOG(LogTemp, Warning, TEXT("Step took %f ms"), TotalTimems);
-	return true;
+	if (Winner != 0)
+	{
+		TakeSolverState(*Waves[Winner]);
+	}
+	UE_LOG(LogSLTilemap, Log, TEXT("Speculative run %d of %d succeeded first"), Winner, NumRuns);
+	return !Cancelled;
 }
 
-bool USLWave::Run()
+void USLWave::TakeSolverState(USLWave& Other)
 {
-	if (!Initialize())
+	//Swapped rather than copied, the other wave reinitializes everything before its next run
+	Swap(OutputTileMap, Other.OutputTileMap);
+	OutputTileMap.MarkAllDirty();
+	Model = Other.Model;
+	Failed = Other.Failed;
+	FailedAtIndex = Other.FailedAtIndex;
+	ObservedCellCount.Set(Other.ObservedCellCount.GetValue());
+	TotalCellCount.Set(Other.TotalCellCount.GetValue());
+	Stats = Other.Stats;
+	WaveSizeX = Other.WaveSizeX;
+	WaveSizeY = Other.WaveSizeY;
+	Swap(CellXArray, Other.CellXArray);
+	Swap(CellYArray, Other.CellYArray);
+	Swap(CellEntropyArray, Other.CellEntropyArray);
+	Swap(CellTieBreakArray, Other.CellTieBreakArray);
+	Swap(CellIsObservedArray, Other.CellIsObservedArray);
+	Swap(EntropyHeap, Other.EntropyHeap);
+	RandomStream = Other.RandomStream;
+	WordsPerCell = Other.WordsPerCell;
+	Swap(CellPatternBits, Other.CellPatternBits);
+	Swap(CellPatternCounts, Other.CellPatternCounts);
+	Swap(CellSumWeights, Other.CellSumWeights);
+	Swap(CellSumWeightLogWeights, Other.CellSumWeightLogWeights);
+	Swap(CellRemovedSupportCounts, Other.CellRemovedSupportCounts);
+	Swap(CellSupportCountStarts, Other.CellSupportCountStarts);
+	Swap(FreeSupportCountStarts, Other.FreeSupportCountStarts);
+	Swap(BanJournal, Other.BanJournal);
+	NextBanToPropagate = Other.NextBanToPropagate;
+	Swap(CellsToUpdate, Other.CellsToUpdate);
+	Swap(CellIsQueuedArray, Other.CellIsQueuedArray);
+	Swap(MapWriteJournal, Other.MapWriteJournal);
+	Swap(Decisions, Other.Decisions);
+	BacktrackCount = Other.BacktrackCount;
+	PendingDirtyRect = Other.PendingDirtyRect;
+}
+
+void USLWave::PrepareSpeculativeRuns(const int32 NumRuns)
+{
+	check(IsInGameThread());
+	while (SpeculativeWaves.Num() < NumRuns - 1)
 	{
-		return false;
+		SpeculativeWaves.Add(NewObject<USLWave>(this));
 	}
-	while (Step())
+}
+
+bool USLWave::HasFailed() const
+{
+	return Failed;
+}
+
+void USLWave::Cancel()
+{
+	CancelRequested = true;
+}
+
+void USLWave::ClearCancel()
+{
+	CancelRequested = false;
+}
+
+bool USLWave::IsCancelled() const
+{
+	return CancelRequested;
+}
+
+float USLWave::GetProgress() const
+{
+	//Speculative runs report the furthest along
+	const int32 TotalCells = TotalCellCount.GetValue();
+	float Progress = TotalCells > 0 ? static_cast<float>(ObservedCellCount.GetValue()) / TotalCells : 0;
+	for (int32 i = 0; i < ActiveSpeculativeRuns.GetValue(); i++)
 	{
-		
+		const USLWave* SpeculativeWave = SpeculativeWaves[i];
+		const int32 SpeculativeTotalCells = SpeculativeWave->TotalCellCount.GetValue();
+		if (SpeculativeTotalCells > 0)
+		{
+			Progress = FMath::Max(Progress, static_cast<float>(SpeculativeWave->ObservedCellCount.GetValue()) / SpeculativeTotalCells);
+		}
 	}
-	return true;
+	return Progress;
+}
+
+FWaveStats USLWave::GetStats() const
+{
+	return Stats;
+}
+
+int32 USLWave::GetBacktrackCount() const
+{
+	return BacktrackCount;
+}
+
+SIZE_T USLWave::GetAllocatedSize() const
+{
+	SIZE_T Size = OutputTileMap.Data.GetAllocatedSize() + EntropyHeap.GetAllocatedSize() + (Model.IsValid() ? Model->GetAllocatedSize() : 0);
+	Size += CellXArray.GetAllocatedSize() + CellYArray.GetAllocatedSize() + CellEntropyArray.GetAllocatedSize() + CellTieBreakArray.GetAllocatedSize() + CellIsObservedArray.GetAllocatedSize();
+	Size += CellPatternBits.GetAllocatedSize() + CellPatternCounts.GetAllocatedSize() + CellSumWeights.GetAllocatedSize() + CellSumWeightLogWeights.GetAllocatedSize();
+	Size += CellRemovedSupportCounts.GetAllocatedSize() + CellSupportCountStarts.GetAllocatedSize() + FreeSupportCountStarts.GetAllocatedSize();
+	Size += BanJournal.GetAllocatedSize() + CellsToUpdate.GetAllocatedSize() + CellIsQueuedArray.GetAllocatedSize() + MapWriteJournal.GetAllocatedSize() + Decisions.GetAllocatedSize();
+	return Size;
+}
+
+UTexture2D* USLWave::UpdateOutputTexture(UTexture2D* Texture)
+{
+	return USLTilemapLib::UpdateTileMapTexture(OutputTileMap, Texture);
+}
+
+bool USLWave::CanSolve() const
+{
+	const bool TilemapsValid = USLTilemapLib::IsTilemapValid(OutputTileMap) && USLTilemapLib::IsTilemapValid(InputTileMap);
+	const bool PatternSizeValid = PatternSize >= SL_MIN_PATTERN_SIZE && PatternSize <= SL_MAX_PATTERN_SIZE;
+	return TilemapsValid && PatternSizeValid && OutputTileMap.SizeX >= PatternSize && OutputTileMap.SizeY >= PatternSize;
+}
+
+bool USLWave::HasModelForInput() const
+{
+	return Model.IsValid() && Model->PatternSize == PatternSize && Model->Symmetry == Symmetry && Model->InputTileMap == InputTileMap;
 }
 
 void USLWave::GeneratePatterns()
 {
-	Patterns.Empty();
-	Counts.Empty();
-	for (int32 y = 0; y < InputTileMap.SizeY - PatternSize + 1; y++)
+	DispatchPatternSize(PatternSize, [this](auto Size)
+	{
+		GeneratePatternsWithPatternSize<decltype(Size)::Value>();
+	});
+}
+
+template <int32 Size>
+void USLWave::GeneratePatternsWithPatternSize()
+{
+	TSharedRef<FWaveModel, ESPMode::ThreadSafe> NewModel = MakeShared<FWaveModel, ESPMode::ThreadSafe>();
+	NewModel->InputTileMap = InputTileMap;
+	NewModel->PatternSize = Size;
+	NewModel->Symmetry = FMath::Clamp(Symmetry, 1, 8);
+
+	//Pack each window into a key and register its symmetries, alternating reflections and rotations
+	TMap<FPatternKey, int32> PatternIndices;
+	for (int32 y = 0; y < InputTileMap.SizeY - Size + 1; y++)
 	{
-		for (int32 x = 0; x < InputTileMap.SizeX - PatternSize + 1; x++)
+		for (int32 x = 0; x < InputTileMap.SizeX - Size + 1; x++)
 		{
-			FTileMap Pattern = USLTilemapLib::GetTilemapSection(InputTileMap, x, y, PatternSize, PatternSize);
-			RegisterPattern(Pattern);
-			Pattern = USLTilemapLib::RotateTilemap(Pattern);
-			RegisterPattern(Pattern);
-			Pattern = USLTilemapLib::RotateTilemap(Pattern);
-			RegisterPattern(Pattern);
-			Pattern = USLTilemapLib::RotateTilemap(Pattern);
-			RegisterPattern(Pattern);
-			Pattern = USLTilemapLib::MirrorTilemap(Pattern);
-			RegisterPattern(Pattern);
-			Pattern = USLTilemapLib::RotateTilemap(Pattern);
-			RegisterPattern(Pattern);
-			Pattern = USLTilemapLib::RotateTilemap(Pattern);
-			RegisterPattern(Pattern);
-			Pattern = USLTilemapLib::RotateTilemap(Pattern);
-			RegisterPattern(Pattern);
+			FPatternKey Pattern;
+			for (int32 j = 0; j < Size; j++)
+			{
+				const uint8* Row = &InputTileMap.Data[USLTilemapLib::TileMapXYToIndex(InputTileMap, x, y + j)];
+				FMemory::Memcpy(&Pattern.Tiles[j * Size], Row, Size);
+			}
+			for (int32 i = 0; i < NewModel->Symmetry; i++)
+			{
+				RegisterPattern(*NewModel, PatternIndices, Pattern);
+				FPatternKey Mirrored;
+				TPattern<Size>::Mirror(Pattern.Tiles, Mirrored.Tiles);
+				if (i % 2 == 0)
+				{
+					Pattern = Mirrored;
+				}
+				else
+				{
+					TPattern<Size>::Rotate(Mirrored.Tiles, Pattern.Tiles);
+				}
+			}
 		}
 	}
 
 	float SumCounts = 0;
-	for (const auto& Count : Counts)
+	for (const auto& Count : NewModel->Counts)
 	{
 		SumCounts += Count;
 	}
 
-	Probabilities.SetNum(Counts.Num());
-	PlogP.SetNum(Counts.Num());
-	for (int32 i = 0; i < Counts.Num(); i++)
+	NewModel->Probabilities.SetNum(NewModel->Counts.Num());
+	NewModel->PlogP.SetNum(NewModel->Counts.Num());
+	NewModel->WeightLogWeights.SetNum(NewModel->Counts.Num());
+	for (int32 i = 0; i < NewModel->Counts.Num(); i++)
+	{
+		const float Probability = NewModel->Counts[i] / SumCounts;
+		NewModel->Probabilities[i] = Probability;
+		NewModel->PlogP[i] = Probability * log2(Probability);
+		//Rounded to a multiple of 2^-20 so the running sums stay exact in a double, a ban rolled back restores them bit for bit
+		NewModel->WeightLogWeights[i] = FMath::RoundToDouble(NewModel->Counts[i] * log2(static_cast<double>(NewModel->Counts[i])) * WeightLogWeightScale) / WeightLogWeightScale;
+	}
+
+	BuildPropagator<Size>(*NewModel);
+	Model = NewModel;
+}
+
+template <int32 Size>
+void USLWave::BuildPropagator(FWaveModel& NewModel)
+{
+	//Precompute, once per pattern set, which patterns may sit next to each pattern in each direction
+	const int32 NumPatterns = NewModel.NumPatterns;
+	NewModel.PropagatorStarts.SetNum(NumDirections * NumPatterns + 1);
+	NewModel.PropagatorPatterns.Empty();
+	for (int32 Direction = 0; Direction < NumDirections; Direction++)
+	{
+		for (int32 PatternIndex = 0; PatternIndex < NumPatterns; PatternIndex++)
+		{
+			NewModel.PropagatorStarts[Direction * NumPatterns + PatternIndex] = NewModel.PropagatorPatterns.Num();
+			for (int32 OtherIndex = 0; OtherIndex < NumPatterns; OtherIndex++)
+			{
+				if (TPattern<Size>::Agree(NewModel.GetPattern(PatternIndex), NewModel.GetPattern(OtherIndex), DirectionX[Direction], DirectionY[Direction]))
+				{
+					NewModel.PropagatorPatterns.Add(OtherIndex);
+				}
+			}
+		}
+	}
+	NewModel.PropagatorStarts[NumDirections * NumPatterns] = NewModel.PropagatorPatterns.Num();
+
+	//A pattern's support in a direction is the number of patterns allowing it from the opposite side
+	NewModel.SupportCounts.SetNum(NumPatterns * NumDirections);
+	for (int32 PatternIndex = 0; PatternIndex < NumPatterns; PatternIndex++)
 	{
-		const float Probability = Counts[i] / SumCounts;
-		Probabilities[i] = Probability;
-		PlogP[i] = Probability * log2(Probability);
-		//UE_LOG(LogTemp, Warning, TEXT("Pattern %d has count %d, probability %f, and PlogP %f"), i, Counts[i], P[i], PlogP[i]);
+		for (int32 Direction = 0; Direction < NumDirections; Direction++)
+		{
+			const int32 Opposite = OppositeDirection[Direction] * NumPatterns + PatternIndex;
+			NewModel.SupportCounts[PatternIndex * NumDirections + Direction] = NewModel.PropagatorStarts[Opposite + 1] - NewModel.PropagatorStarts[Opposite];
+		}
 	}
 }
 
 void USLWave::InitPatternCells()
 {
 	//Calculate constants
-	const int32 WaveSizeX = OutputTileMap.SizeX - PatternSize + 1;
-	const int32 WaveSizeY = OutputTileMap.SizeY - PatternSize + 1;
-	const int32 NeighborDistance = PatternSize - 1;
+	WaveSizeX = OutputTileMap.SizeX - PatternSize + 1;
+	WaveSizeY = OutputTileMap.SizeY - PatternSize + 1;
 	const int32 ArrayNum = WaveSizeX * WaveSizeY;
+	const int32 NumPatterns = Model->NumPatterns;
+	WordsPerCell = FMath::DivideAndRoundUp(NumPatterns, 64);
 
 	//Size Arrays
-	CellArray.SetNum(ArrayNum);
 	CellXArray.SetNum(ArrayNum);
 	CellYArray.SetNum(ArrayNum);
 	CellEntropyArray.SetNum(ArrayNum);
+	CellTieBreakArray.SetNum(ArrayNum);
 	CellIsObservedArray.SetNum(ArrayNum);
-
-	//Cache AllowedPatternIndices
-	TArray<int32> AllowedPatternIndices;
-	for (int32 i = 0; i < Patterns.Num(); i++)
+	CellPatternCounts.SetNum(ArrayNum);
+	CellSumWeights.SetNum(ArrayNum);
+	CellSumWeightLogWeights.SetNum(ArrayNum);
+	CellPatternBits.SetNum(ArrayNum * WordsPerCell);
+	CellRemovedSupportCounts.Reset();
+	CellSupportCountStarts.Init(INDEX_NONE, ArrayNum);
+	FreeSupportCountStarts.Reset();
+	BanJournal.Reset();
+	NextBanToPropagate = 0;
+	CellsToUpdate.Reset();
+	CellIsQueuedArray.Init(false, ArrayNum);
+	MapWriteJournal.Reset();
+	Decisions.Reset();
+	BacktrackCount = 0;
+	PendingDirtyRect = NoPendingDirtyRect;
+
+	//Cache the all patterns allowed state
+	TArray<uint64> AllowedPatternBits;
+	AllowedPatternBits.Init(~0ull, WordsPerCell);
+	if (NumPatterns % 64 != 0)
 	{
-		AllowedPatternIndices.Add(i);
+		AllowedPatternBits.Last() = (1ull << (NumPatterns % 64)) - 1;
 	}
+	int32 InitialSumWeights = 0;
+	double InitialSumWeightLogWeights = 0;
+	for (int32 PatternIndex = 0; PatternIndex < NumPatterns; PatternIndex++)
+	{
+		InitialSumWeights += Model->Counts[PatternIndex];
+		InitialSumWeightLogWeights += Model->WeightLogWeights[PatternIndex];
+	}
+	//Same formula as UpdateCellEntropy, so a cell rolled back to all patterns gets the same key it started with
+	const float InitialEntropy = GetEntropy(InitialSumWeights, InitialSumWeightLogWeights);
 
 	//Create PatternCells and initialize them
+	RandomStream.Initialize(Seed);
 	for (int32 Y = 0; Y < WaveSizeY; Y++)
 	{
 		for (int32 X = 0; X < WaveSizeX; X++)
 		{
-			TArray<int32> Neighbors;
-			for (int32 OffsetY = -NeighborDistance; OffsetY <= NeighborDistance; OffsetY++)
-			{
-				for (int32 OffsetX = -NeighborDistance; OffsetX <= NeighborDistance; OffsetX++)
-				{
-					const int32 NeighborX = X + OffsetX;
-					const int32 NeighborY = Y + OffsetY;
-					const int32 NeighborIndex = USLTilemapLib::XYToIndex(WaveSizeX, NeighborX, NeighborY);
-					if (NeighborX > -1 && NeighborX < WaveSizeX && NeighborY > -1 && NeighborY < WaveSizeY && !(OffsetX == 0 && OffsetY == 0))
-					{
-						Neighbors.Add(NeighborIndex);
-					}
-				}
-			}
 			const int32 CellIndex = USLTilemapLib::XYToIndex(WaveSizeX, X, Y);
 			CellXArray[CellIndex] = X;
 			CellYArray[CellIndex] = Y;
-			CellArray[CellIndex] = FCell(AllowedPatternIndices, Neighbors);
+			CellEntropyArray[CellIndex] = InitialEntropy;
+			CellTieBreakArray[CellIndex] = RandomStream.GetUnsignedInt();
+			CellIsObservedArray[CellIndex] = NumPatterns == 1;
+			CellPatternCounts[CellIndex] = NumPatterns;
+			CellSumWeights[CellIndex] = InitialSumWeights;
+			CellSumWeightLogWeights[CellIndex] = InitialSumWeightLogWeights;
+			FMemory::Memcpy(&CellPatternBits[CellIndex * WordsPerCell], AllowedPatternBits.GetData(), WordsPerCell * sizeof(uint64));
 		}
 	}
+
+	ObservedCellCount.Set(NumPatterns == 1 ? ArrayNum : 0);
+	TotalCellCount.Set(ArrayNum);
+
+	//Queue every cell for observation
+	EntropyHeap.Build(CellEntropyArray, CellTieBreakArray);
+	if (NumPatterns == 1)
+	{
+		EntropyHeap.Empty();
+	}
 }
 
-void USLWave::RegisterPattern(const FTileMap& Pattern)
+void USLWave::RegisterPattern(FWaveModel& NewModel, TMap<FPatternKey, int32>& PatternIndices, const FPatternKey& Pattern)
 {
-	const int Index = Patterns.Find(Pattern);
-	if (Index > -1)
+	const int32* Index = PatternIndices.Find(Pattern);
+	if (Index)
 	{
-		Counts[Index]++;
+		NewModel.Counts[*Index]++;
 	}
 	else
 	{
-		Patterns.Add(Pattern);
-		Counts.Add(1);
+		NewModel.PatternData.Append(Pattern.Tiles, FPatternBlock::NumBytes);
+		PatternIndices.Add(Pattern, NewModel.NumPatterns++);
+		NewModel.Counts.Add(1);
 	}
 }
 
-
-bool USLWave::UpdateCell(const int32 CellIndex)
+template <int32 Size>
+bool USLWave::StepWithPatternSize()
 {
-	// Updates Cell state based on underlying OutputTileMap state
+	const double StartTime = FPlatformTime::Seconds();
+	//Find unobserved PatternCell with lowest entropy
+	int32 CellToObserve = -1;
+	EntropyHeap.Pop(CellToObserve);
 
-	//Cache values
-	const int32 X = CellXArray[CellIndex];
-	const int32 Y = CellYArray[CellIndex];
-	const int32 PreNumPatterns = CellArray[CellIndex].AllowedPatternIndices.Num();
+	//Check for no unobserved cells found
+	if (CellToObserve == -1)
+	{
+		UE_LOG(LogSLTilemap, Verbose, TEXT("No unobserved cell was found"));
+		return false;
+	}
 
-	//PreNumPatterns should never be 0
-	check(PreNumPatterns > 0);
+	//Observe Pattern cell with lowest entropy if found and propegate
+	UE_LOG(LogSLTilemap, Verbose, TEXT("Observing cell at %d,%d and it has entropy %f"), CellXArray[CellToObserve], CellYArray[CellToObserve], CellEntropyArray[CellToObserve]);
+	ObserveCell<Size>(CellToObserve);
+	Propagate<Size>();
+	while (Failed && Backtrack<Size>())
+	{
+		Propagate<Size>();
+	}
 
-	//Update allowed patterns
-	for (int32 i = PreNumPatterns - 1; i >= 0; i--)
+	const double EndTime = FPlatformTime::Seconds();
+	const double TotalTimems = 1000 * (EndTime - StartTime);
+	Stats.StepMs += TotalTimems;
+	Stats.NumSteps++;
+	if (Failed)
 	{
-		//Does pattern still fit?
-		const int32 PatternIndex = CellArray[CellIndex].AllowedPatternIndices[i];
-		if (!CanPatternFitAtThisLocation(Patterns[PatternIndex], X, Y))
+		OnFailed();
+		return false;
+	}
+	UE_LOG(LogSLTilemap, Verbose, TEXT("Step took %f ms"), TotalTimems);
+	return true;
+}
+
+template <int32 Size>
+void USLWave::BanUnfitPatterns()
+{
+	//Ban patterns that don't fit the initial state of OutputTileMap, then propagate
+	for (int32 CellIndex = 0; CellIndex < CellXArray.Num() && !Failed; CellIndex++)
+	{
+		for (int32 PatternIndex = 0; PatternIndex < Model->NumPatterns && !Failed; PatternIndex++)
 		{
-			CellArray[CellIndex].AllowedPatternIndices.RemoveAt(i);
+			if (!CanPatternFitAtThisLocation<Size>(Model->GetPattern(PatternIndex), CellXArray[CellIndex], CellYArray[CellIndex]))
+			{
+				BanPattern(CellIndex, PatternIndex);
+			}
 		}
 	}
-	const int32 PostNumPatterns = CellArray[CellIndex].AllowedPatternIndices.Num();
+	Propagate<Size>();
+}
+
+int32 USLWave::GetNeighborIndex(const int32 CellIndex, const int32 Direction) const
+{
+	const int32 NeighborX = CellXArray[CellIndex] + DirectionX[Direction];
+	const int32 NeighborY = CellYArray[CellIndex] + DirectionY[Direction];
+	const bool IsInWave = NeighborX > -1 && NeighborX < WaveSizeX && NeighborY > -1 && NeighborY < WaveSizeY;
+	return IsInWave ? CellIndex + DirectionY[Direction] * WaveSizeX + DirectionX[Direction] : INDEX_NONE;
+}
 
-	//Check if cell changed state
-	const bool CellChangedState = !(PreNumPatterns == PostNumPatterns);
+bool USLWave::IsPatternAllowed(const int32 CellIndex, const int32 PatternIndex) const
+{
+	const uint64 Word = CellPatternBits[CellIndex * WordsPerCell + (PatternIndex >> 6)];
+	return (Word >> (PatternIndex & 63)) & 1;
+}
 
-	//Check for failure
-	if (PostNumPatterns == 0)
+void USLWave::BanPattern(const int32 CellIndex, const int32 PatternIndex)
+{
+	CellPatternBits[CellIndex * WordsPerCell + (PatternIndex >> 6)] &= ~(1ull << (PatternIndex & 63));
+	CellPatternCounts[CellIndex]--;
+	CellSumWeights[CellIndex] -= Model->Counts[PatternIndex];
+	CellSumWeightLogWeights[CellIndex] -= Model->WeightLogWeights[PatternIndex];
+	BanJournal.Add(FPatternBan(CellIndex, PatternIndex));
+	if (!CellIsQueuedArray[CellIndex])
+	{
+		CellIsQueuedArray[CellIndex] = true;
+		CellsToUpdate.Add(CellIndex);
+	}
+	if (CellPatternCounts[CellIndex] == 0)
 	{
 		Failed = true;
 		FailedAtIndex = CellIndex;
-		return CellChangedState;
 	}
+}
+
+template <int32 Size>
+void USLWave::Propagate()
+{
+	// Each ban removes one unit of support from the compatible patterns of each neighbor,
+	// patterns left without support in any direction are banned in turn
+	const int32 NumPatterns = Model->NumPatterns;
+	while (!Failed && NextBanToPropagate < BanJournal.Num())
+	{
+		const FPatternBan Ban = BanJournal[NextBanToPropagate++];
+		for (int32 Direction = 0; Direction < NumDirections; Direction++)
+		{
+			const int32 NeighborIndex = GetNeighborIndex(Ban.CellIndex, Direction);
+			if (NeighborIndex == INDEX_NONE)
+			{
+				continue;
+			}
+			const int32 PropagatorIndex = Direction * NumPatterns + Ban.PatternIndex;
+
+			//Observed cells have no counters, their one pattern is checked against the banned cell's bits instead
+			if (CellSupportCountStarts[NeighborIndex] == INDEX_NONE && CellIsObservedArray[NeighborIndex])
+			{
+				for (int32 i = Model->PropagatorStarts[PropagatorIndex]; i < Model->PropagatorStarts[PropagatorIndex + 1]; i++)
+				{
+					const int32 PatternIndex = Model->PropagatorPatterns[i];
+					if (IsPatternAllowed(NeighborIndex, PatternIndex))
+					{
+						if (!IsPatternSupported(NeighborIndex, PatternIndex, OppositeDirection[Direction]))
+						{
+							BanPattern(NeighborIndex, PatternIndex);
+						}
+						break;
+					}
+				}
+				continue;
+			}
+
+			//The first ban to reach a cell gives it counters, all zero since nothing was banned next to it before
+			if (CellSupportCountStarts[NeighborIndex] == INDEX_NONE)
+			{
+				AddSupportCounts(NeighborIndex);
+			}
+			uint16* RemovedSupportCounts = &CellRemovedSupportCounts[CellSupportCountStarts[NeighborIndex]];
+			for (int32 i = Model->PropagatorStarts[PropagatorIndex]; i < Model->PropagatorStarts[PropagatorIndex + 1]; i++)
+			{
+				const int32 PatternIndex = Model->PropagatorPatterns[i];
+				uint16& RemovedSupport = RemovedSupportCounts[PatternIndex * NumDirections + Direction];
+				RemovedSupport++;
+				if (RemovedSupport == Model->SupportCounts[PatternIndex * NumDirections + Direction] && IsPatternAllowed(NeighborIndex, PatternIndex))
+				{
+					BanPattern(NeighborIndex, PatternIndex);
+				}
+			}
+		}
+	}
+	if (!IsBacktracking())
+	{
+		BanJournal.Reset();
+		NextBanToPropagate = 0;
+	}
+
+	//Update cells that lost patterns
+	for (const int32 CellIndex : CellsToUpdate)
+	{
+		CellIsQueuedArray[CellIndex] = false;
+		if (!Failed)
+		{
+			UpdateCell<Size>(CellIndex);
+		}
+	}
+	CellsToUpdate.Reset();
+	MarkPendingDirtyRect();
+}
+
+template <int32 Size>
+void USLWave::UpdateCell(const int32 CellIndex)
+{
+	// Updates derived Cell state and OutputTileMap after the cell lost patterns
+	const int32 NumPatterns = CellPatternCounts[CellIndex];
+
+	//NumPatterns should never be 0
+	check(NumPatterns > 0);
+
+	//Update Map Data with new cell state
+	alignas(16) uint8 CombinedPatterns[FPatternBlock::NumBytes];
+	OrCellPatternsTogether<Size>(CellIndex, CombinedPatterns);
+	WritePatternToMapData<Size>(CombinedPatterns, CellXArray[CellIndex], CellYArray[CellIndex]);
 
 	//Check for implicit observation
-	if (PostNumPatterns == 1)
+	if (NumPatterns == 1)
 	{
-		ObserveCell(CellIndex);
-		return CellChangedState;
+		MarkCellObserved(CellIndex);
+		return;
 	}
 
-	//Update Entropy
-	float SumP = 0;
-	float SumPlogP = 0;
-	for (const auto& i : CellArray[CellIndex].AllowedPatternIndices)
+	UpdateCellEntropy(CellIndex);
+}
+
+void USLWave::UpdateCellEntropy(const int32 CellIndex)
+{
+	CellEntropyArray[CellIndex] = GetEntropy(CellSumWeights[CellIndex], CellSumWeightLogWeights[CellIndex]);
+	EntropyHeap.Update(CellIndex, CellEntropyArray[CellIndex]);
+	UE_LOG(LogSLTilemap, VeryVerbose, TEXT("Cell %d has entropy %f"), CellIndex, CellEntropyArray[CellIndex]);
+}
+
+bool USLWave::IsBacktracking() const
+{
+	return MaxBacktracks > 0;
+}
+
+template <int32 Size>
+bool USLWave::Backtrack()
+{
+	if (Decisions.Num() == 0 || BacktrackCount >= MaxBacktracks)
 	{
-		SumP += Probabilities[i];
-		SumPlogP += PlogP[i];
+		return false;
 	}
-	CellEntropyArray[CellIndex] = log2(SumP) - SumPlogP / SumP;
-	UE_LOG(LogTemp, Warning, TEXT("Cell %d has entropy %f"), CellIndex, CellEntropyArray[CellIndex]);
-	return CellChangedState;
+	BacktrackCount++;
+	const FWaveDecision Decision = Decisions.Pop(false);
+	RollBack(Decision);
+	Failed = false;
+	UE_LOG(LogSLTilemap, Verbose, TEXT("Backtracking to cell at %d,%d"), CellXArray[Decision.CellIndex], CellYArray[Decision.CellIndex]);
+
+	//The observed pattern led to a contradiction, so it's banned as part of the previous decision
+	BanPattern(Decision.CellIndex, Decision.PatternIndex);
+	return true;
+}
+
+void USLWave::RollBack(const FWaveDecision& Decision)
+{
+	//Rare next to Step, so not compiled per pattern size
+	const int32 NumPatterns = Model->NumPatterns;
+	const int32 Size = Model->PatternSize;
+
+	//Restore overwritten map windows, newest first
+	for (int32 i = MapWriteJournal.Num() - 1; i >= Decision.MapWriteJournalNum; i--)
+	{
+		const FMapWrite& MapWrite = MapWriteJournal[i];
+		uint8* Window = &OutputTileMap.Data[USLTilemapLib::TileMapXYToIndex(OutputTileMap, MapWrite.X, MapWrite.Y)];
+		for (int32 Row = 0; Row < Size; Row++)
+		{
+			FMemory::Memcpy(&Window[Row * OutputTileMap.SizeX], &MapWrite.Tiles[Row * Size], Size);
+		}
+		AddPendingDirtyRect(MapWrite.X, MapWrite.Y, Size);
+	}
+	MapWriteJournal.SetNum(Decision.MapWriteJournalNum, false);
+
+	//Allow banned patterns again, handing back the support taken by bans that were already propagated
+	for (int32 i = BanJournal.Num() - 1; i >= Decision.BanJournalNum; i--)
+	{
+		const FPatternBan& Ban = BanJournal[i];
+		if (i < NextBanToPropagate)
+		{
+			for (int32 Direction = 0; Direction < NumDirections; Direction++)
+			{
+				//Cells without counters were observed, they get rebuilt counters below if they are unobserved again
+				const int32 NeighborIndex = GetNeighborIndex(Ban.CellIndex, Direction);
+				if (NeighborIndex == INDEX_NONE || CellSupportCountStarts[NeighborIndex] == INDEX_NONE)
+				{
+					continue;
+				}
+				uint16* RemovedSupportCounts = &CellRemovedSupportCounts[CellSupportCountStarts[NeighborIndex]];
+				const int32 PropagatorIndex = Direction * NumPatterns + Ban.PatternIndex;
+				for (int32 j = Model->PropagatorStarts[PropagatorIndex]; j < Model->PropagatorStarts[PropagatorIndex + 1]; j++)
+				{
+					RemovedSupportCounts[Model->PropagatorPatterns[j] * NumDirections + Direction]--;
+				}
+			}
+		}
+		CellPatternBits[Ban.CellIndex * WordsPerCell + (Ban.PatternIndex >> 6)] |= 1ull << (Ban.PatternIndex & 63);
+		CellPatternCounts[Ban.CellIndex]++;
+		CellSumWeights[Ban.CellIndex] += Model->Counts[Ban.PatternIndex];
+		CellSumWeightLogWeights[Ban.CellIndex] += Model->WeightLogWeights[Ban.PatternIndex];
+	}
+
+	//Cells that regained patterns are unobserved again
+	for (int32 i = Decision.BanJournalNum; i < BanJournal.Num(); i++)
+	{
+		const int32 CellIndex = BanJournal[i].CellIndex;
+		if (CellPatternCounts[CellIndex] < 2)
+		{
+			continue;
+		}
+		if (CellIsObservedArray[CellIndex])
+		{
+			CellIsObservedArray[CellIndex] = false;
+			ObservedCellCount.Decrement();
+			RebuildSupportCounts(CellIndex);
+		}
+		UpdateCellEntropy(CellIndex);
+	}
+	BanJournal.SetNum(Decision.BanJournalNum, false);
+	NextBanToPropagate = Decision.BanJournalNum;
 }
 
 void USLWave::OnFailed()
 {
-	UE_LOG(LogTemp, Warning, TEXT("Failed at cell %d, %d"), CellXArray[FailedAtIndex], CellYArray[FailedAtIndex]);
+	UE_LOG(LogSLTilemap, Warning, TEXT("Failed at cell %d, %d"), CellXArray[FailedAtIndex], CellYArray[FailedAtIndex]);
 }
 
-void USLWave::WritePatternToMapData(const FTileMap& Pattern, int32 x, int32 y)
+template <int32 Size>
+void USLWave::WritePatternToMapData(const uint8* Pattern, int32 x, int32 y)
 {
-	for (int32 j = 0; j < Pattern.SizeY; j++)
+	uint8* Window = &OutputTileMap.Data[USLTilemapLib::TileMapXYToIndex(OutputTileMap, x, y)];
+	if (IsBacktracking())
 	{
-		for (int32 i = 0; i < Pattern.SizeX; i++)
+		FMapWrite& MapWrite = MapWriteJournal.AddDefaulted_GetRef();
+		MapWrite.X = x;
+		MapWrite.Y = y;
+		for (int32 Row = 0; Row < Size; Row++)
 		{
-			const uint8 Temp = USLTilemapLib::GetTileAtXY(Pattern, i, j);
-			USLTilemapLib::SetTileAtXY(OutputTileMap, Temp, x + i, y + j);
+			FMemory::Memcpy(&MapWrite.Tiles[Row * Size], &Window[Row * OutputTileMap.SizeX], Size);
 		}
 	}
+	TPattern<Size>::Write(Pattern, Window, OutputTileMap.SizeX);
+	AddPendingDirtyRect(x, y, Size);
 }
 
-bool USLWave::CanPatternFitAtThisLocation(const FTileMap& Pattern, int32 x, int32 y) const
+template <int32 Size>
+bool USLWave::CanPatternFitAtThisLocation(const uint8* Pattern, int32 x, int32 y) const
 {
-	for (int32 j = 0; j < Pattern.SizeY; j++)
+	return TPattern<Size>::Fits(Pattern, &OutputTileMap.Data[USLTilemapLib::TileMapXYToIndex(OutputTileMap, x, y)], OutputTileMap.SizeX);
+}
+
+template <int32 Size>
+void USLWave::ObserveCell(const int32 CellIndex)
+{
+	const int32 BanJournalNum = BanJournal.Num();
+	const int32 MapWriteJournalNum = MapWriteJournal.Num();
+
+	//Pick an allowed pattern with probability proportional to its count in the input
+	int32 RandomCount = RandomStream.RandRange(0, CellSumWeights[CellIndex] - 1);
+
+	//Ban all other patterns, walking a copy of each word since banning clears bits
+	int32 IndexOfPatternToObserve = INDEX_NONE;
+	for (int32 Word = 0; Word < WordsPerCell; Word++)
 	{
-		for (int32 i = 0; i < Pattern.SizeX; i++)
+		uint64 Bits = CellPatternBits[CellIndex * WordsPerCell + Word];
+		while (Bits)
 		{
-			const uint8 MapTileState = USLTilemapLib::GetTileAtXY(OutputTileMap, x + i, y + j);
-			const uint8 PatternTileState = USLTilemapLib::GetTileAtXY(Pattern, i, j);
-			const uint8 Test = MapTileState & PatternTileState;
-			if (Test != PatternTileState)
+			const int32 PatternIndex = Word * 64 + FMath::CountTrailingZeros64(Bits);
+			Bits &= Bits - 1;
+			if (IndexOfPatternToObserve == INDEX_NONE && RandomCount < Model->Counts[PatternIndex])
 			{
-				return false;
+				IndexOfPatternToObserve = PatternIndex;
+				continue;
 			}
+			RandomCount -= Model->Counts[PatternIndex];
+			BanPattern(CellIndex, PatternIndex);
 		}
 	}
-	return true;
+	WritePatternToMapData<Size>(Model->GetPattern(IndexOfPatternToObserve), CellXArray[CellIndex], CellYArray[CellIndex]);
+	MarkCellObserved(CellIndex);
+	if (IsBacktracking())
+	{
+		Decisions.Add(FWaveDecision(CellIndex, IndexOfPatternToObserve, BanJournalNum, MapWriteJournalNum));
+	}
+}
+
+void USLWave::AddPendingDirtyRect(const int32 X, const int32 Y, const int32 Size)
+{
+	PendingDirtyRect.Include(FIntPoint(X, Y));
+	PendingDirtyRect.Include(FIntPoint(X + Size, Y + Size));
 }
 
+void USLWave::MarkPendingDirtyRect()
+{
+	if (PendingDirtyRect.Min.X < PendingDirtyRect.Max.X)
+	{
+		OutputTileMap.MarkDirty(PendingDirtyRect.Min.X, PendingDirtyRect.Min.Y, PendingDirtyRect.Width(), PendingDirtyRect.Height());
+		PendingDirtyRect = NoPendingDirtyRect;
+	}
+}
 
-//TODO implement weights/probabilities
-void USLWave::ObserveCell(const int32 CellIndex)
+void USLWave::MarkCellObserved(const int32 CellIndex)
+{
+	if (!CellIsObservedArray[CellIndex])
+	{
+		CellIsObservedArray[CellIndex] = true;
+		EntropyHeap.Remove(CellIndex);
+		ObservedCellCount.Increment();
+		RemoveSupportCounts(CellIndex);
+	}
+}
+
+bool USLWave::IsPatternSupported(const int32 CellIndex, const int32 PatternIndex, const int32 Direction) const
+{
+	const int32 NeighborIndex = GetNeighborIndex(CellIndex, Direction);
+	if (NeighborIndex == INDEX_NONE)
+	{
+		return true;
+	}
+	const int32 PropagatorIndex = Direction * Model->NumPatterns + PatternIndex;
+	for (int32 i = Model->PropagatorStarts[PropagatorIndex]; i < Model->PropagatorStarts[PropagatorIndex + 1]; i++)
+	{
+		if (IsPatternAllowed(NeighborIndex, Model->PropagatorPatterns[i]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void USLWave::AddSupportCounts(const int32 CellIndex)
 {
-	const int32 RandomIndex = FMath::RandRange(0, CellArray[CellIndex].AllowedPatternIndices.Num() - 1);
-	const int32 IndexOfPatternToObserve = CellArray[CellIndex].AllowedPatternIndices[RandomIndex];
-	const FTileMap ObservedPattern = Patterns[IndexOfPatternToObserve];
-	WritePatternToMapData(ObservedPattern, CellXArray[CellIndex], CellYArray[CellIndex]);
-	CellIsObservedArray[CellIndex] = true;
+	const int32 NumCounts = Model->NumPatterns * NumDirections;
+	int32 Start;
+	if (FreeSupportCountStarts.Num() > 0)
+	{
+		Start = FreeSupportCountStarts.Pop(false);
+	}
+	else
+	{
+		Start = CellRemovedSupportCounts.AddUninitialized(NumCounts);
+	}
+	FMemory::Memzero(&CellRemovedSupportCounts[Start], NumCounts * sizeof(uint16));
+	CellSupportCountStarts[CellIndex] = Start;
 }
 
-//TODO Make Sure this is correct
-FTileMap USLWave::OrCellPatternsTogether(const int32 CellIndex)
+void USLWave::RemoveSupportCounts(const int32 CellIndex)
 {
-	FTileMap Out = FTileMap(PatternSize, PatternSize, 0);
-	//for (int32 PatternIndex = 0; PatternIndex < CellArray[CellIndex].AllowedPatternIndices.Num(); PatternIndex++)
-	for (int32 Index = 0; Index < CellArray[CellIndex].AllowedPatternIndices.Num(); Index++)
+	if (CellSupportCountStarts[CellIndex] != INDEX_NONE)
 	{
-		const int32 PatternIndex = CellArray[CellIndex].AllowedPatternIndices[Index];
-		for (int32 i = 0; i < Out.Data.Num(); i++)
+		FreeSupportCountStarts.Add(CellSupportCountStarts[CellIndex]);
+		CellSupportCountStarts[CellIndex] = INDEX_NONE;
+	}
+}
+
+void USLWave::RebuildSupportCounts(const int32 CellIndex)
+{
+	//Every ban left in the journal has been propagated, so what a neighbor's bits no longer allow is exactly what was counted
+	const int32 NumPatterns = Model->NumPatterns;
+	AddSupportCounts(CellIndex);
+	uint16* RemovedSupportCounts = &CellRemovedSupportCounts[CellSupportCountStarts[CellIndex]];
+	for (int32 Direction = 0; Direction < NumDirections; Direction++)
+	{
+		//Counters in Direction count bans in the neighbor on the opposite side
+		const int32 NeighborIndex = GetNeighborIndex(CellIndex, OppositeDirection[Direction]);
+		if (NeighborIndex == INDEX_NONE)
+		{
+			continue;
+		}
+		for (int32 PatternIndex = 0; PatternIndex < NumPatterns; PatternIndex++)
 		{
-			Out.Data[i] = Out.Data[i] | Patterns[PatternIndex].Data[i];
+			const int32 PropagatorIndex = OppositeDirection[Direction] * NumPatterns + PatternIndex;
+			uint16 RemainingSupport = 0;
+			for (int32 i = Model->PropagatorStarts[PropagatorIndex]; i < Model->PropagatorStarts[PropagatorIndex + 1]; i++)
+			{
+				RemainingSupport += IsPatternAllowed(NeighborIndex, Model->PropagatorPatterns[i]) ? 1 : 0;
+			}
+			RemovedSupportCounts[PatternIndex * NumDirections + Direction] = Model->SupportCounts[PatternIndex * NumDirections + Direction] - RemainingSupport;
 		}
 	}
-	return Out;
-}
\ No newline at end of file
+}
+
+template <int32 Size>
+void USLWave::OrCellPatternsTogether(const int32 CellIndex, uint8* OutPattern) const
+{
+	TPattern<Size>::OrAllowed(Model->PatternData.GetData(), &CellPatternBits[CellIndex * WordsPerCell], WordsPerCell, OutPattern);
+}
@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Misc/AutomationTest.h"
+#include "SLEntropyHeap.h"
+
+namespace
+{
+	//Reference heap, a linear search for the lowest key, ties broken like FEntropyHeap by tie break and then by index
+	struct FReferenceHeap
+	{
+		TMap<int32, float> Keys;
+		TArray<uint32> TieBreaks;
+
+		bool FindMin(int32& OutIndex) const
+		{
+			OutIndex = INDEX_NONE;
+			for (const auto& Pair : Keys)
+			{
+				if (OutIndex == INDEX_NONE || IsLess(Pair.Key, OutIndex))
+				{
+					OutIndex = Pair.Key;
+				}
+			}
+			return OutIndex != INDEX_NONE;
+		}
+
+		bool IsLess(const int32 A, const int32 B) const
+		{
+			if (Keys[A] != Keys[B])
+			{
+				return Keys[A] < Keys[B];
+			}
+			const uint32 TieBreakA = TieBreaks.IsValidIndex(A) ? TieBreaks[A] : 0;
+			const uint32 TieBreakB = TieBreaks.IsValidIndex(B) ? TieBreaks[B] : 0;
+			return TieBreakA < TieBreakB || (TieBreakA == TieBreakB && A < B);
+		}
+	};
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSLEntropyHeapMatchesLinearSearchTest, "SLTilemap.EntropyHeap.MatchesLinearSearch", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::SmokeFilter)
+
+bool FSLEntropyHeapMatchesLinearSearchTest::RunTest(const FString& Parameters)
+{
+	//Few distinct keys and tie breaks so ties are common, Update also inserts indices past the ones Build was given
+	constexpr int32 NumBuiltIndices = 32;
+	constexpr int32 NumIndices = 48;
+	FRandomStream Random(1);
+	for (int32 Trial = 0; Trial < 16; Trial++)
+	{
+		TArray<float> Keys;
+		TArray<uint32> TieBreaks;
+		FReferenceHeap Reference;
+		for (int32 i = 0; i < NumBuiltIndices; i++)
+		{
+			Keys.Add(Random.RandRange(0, 7) * 0.5f);
+			TieBreaks.Add(Random.RandRange(0, 3));
+			Reference.Keys.Add(i, Keys[i]);
+		}
+		Reference.TieBreaks = TieBreaks;
+		FEntropyHeap Heap;
+		Heap.Build(Keys, TieBreaks);
+
+		for (int32 Operation = 0; Operation < 2000; Operation++)
+		{
+			const int32 Roll = Random.RandRange(0, 9);
+			const int32 Index = Random.RandRange(0, NumIndices - 1);
+			if (Roll < 5)
+			{
+				const float Key = Random.RandRange(0, 7) * 0.5f;
+				Heap.Update(Index, Key);
+				Reference.Keys.Add(Index, Key);
+			}
+			else if (Roll < 7)
+			{
+				Heap.Remove(Index);
+				Reference.Keys.Remove(Index);
+			}
+			else
+			{
+				int32 Popped = INDEX_NONE;
+				int32 Expected = INDEX_NONE;
+				const bool bPopped = Heap.Pop(Popped);
+				const bool bExpected = Reference.FindMin(Expected);
+				if (bPopped != bExpected || Popped != Expected)
+				{
+					AddError(FString::Printf(TEXT("Trial %d, operation %d popped %d, expected %d"), Trial, Operation, bPopped ? Popped : INDEX_NONE, Expected));
+					return false;
+				}
+				Reference.Keys.Remove(Expected);
+			}
+
+			if (Heap.Num() != Reference.Keys.Num() || Heap.Contains(Index) != Reference.Keys.Contains(Index))
+			{
+				AddError(FString::Printf(TEXT("Trial %d, operation %d holds %d indices, expected %d"), Trial, Operation, Heap.Num(), Reference.Keys.Num()));
+				return false;
+			}
+		}
+
+		//Draining pops every index in order
+		int32 Popped = INDEX_NONE;
+		int32 Expected = INDEX_NONE;
+		while (Reference.FindMin(Expected))
+		{
+			if (!Heap.Pop(Popped) || Popped != Expected)
+			{
+				AddError(FString::Printf(TEXT("Trial %d drained %d, expected %d"), Trial, Popped, Expected));
+				return false;
+			}
+			Reference.Keys.Remove(Expected);
+		}
+		TestFalse(TEXT("Drained heap pops nothing"), Heap.Pop(Popped));
+	}
+	return true;
+}
+
+#endif
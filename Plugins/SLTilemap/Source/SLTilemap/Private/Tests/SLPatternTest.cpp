@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Misc/AutomationTest.h"
+#include "SLPattern.h"
+
+namespace
+{
+	//Mostly single states like an authored map, with some unknown tiles and some partly solved ones like an output being solved
+	uint8 RandomTile(FRandomStream& Random)
+	{
+		const int32 Roll = Random.RandRange(0, 9);
+		if (Roll == 0)
+		{
+			return 0xFF;
+		}
+		if (Roll == 1)
+		{
+			return static_cast<uint8>(Random.RandRange(1, 255));
+		}
+		return static_cast<uint8>(1 << Random.RandRange(0, 7));
+	}
+
+	template <int32 Size>
+	bool TestPatternSize(FAutomationTestBase& Test, FRandomStream& Random)
+	{
+		//Three words of pattern bits, the last one partly used
+		constexpr int32 NumPatterns = 150;
+		constexpr int32 NumWords = (NumPatterns + 63) / 64;
+		constexpr int32 NumTiles = TPattern<Size>::NumTiles;
+		//Map rows wider than a pattern, so windows sit among tiles Fits must ignore
+		constexpr int32 MapStride = SL_MAX_PATTERN_SIZE + 3;
+
+		//Patterns are zero padded to a whole block, as USLWave stores them
+		TArray<uint8> PatternData;
+		PatternData.SetNumZeroed(NumPatterns * FPatternBlock::NumBytes);
+		for (int32 PatternIndex = 0; PatternIndex < NumPatterns; PatternIndex++)
+		{
+			for (int32 i = 0; i < NumTiles; i++)
+			{
+				PatternData[PatternIndex * FPatternBlock::NumBytes + i] = RandomTile(Random);
+			}
+		}
+
+		TArray<uint8> Map;
+		Map.SetNumUninitialized(Size * MapStride);
+		for (int32 PatternIndex = 0; PatternIndex < NumPatterns; PatternIndex++)
+		{
+			const uint8* Pattern = &PatternData[PatternIndex * FPatternBlock::NumBytes];
+			for (int32 Trial = 0; Trial < 8; Trial++)
+			{
+				//Half the windows hold the pattern plus extra bits so both results are covered, one tile may then lose the pattern's bits
+				for (uint8& Tile : Map)
+				{
+					Tile = RandomTile(Random);
+				}
+				if (Trial % 2 == 0)
+				{
+					for (int32 i = 0; i < NumTiles; i++)
+					{
+						Map[(i / Size) * MapStride + i % Size] |= Pattern[i];
+					}
+					if (Trial % 4 == 2)
+					{
+						const int32 i = Random.RandRange(0, NumTiles - 1);
+						Map[(i / Size) * MapStride + i % Size] &= ~Pattern[i];
+					}
+				}
+				const bool Vector = TPattern<Size>::Fits(Pattern, Map.GetData(), MapStride);
+				const bool Scalar = TPattern<Size>::FitsScalar(Pattern, Map.GetData(), MapStride);
+				if (Vector != Scalar)
+				{
+					Test.AddError(FString::Printf(TEXT("Fits differs from FitsScalar for size %d, pattern %d, trial %d"), Size, PatternIndex, Trial));
+					return false;
+				}
+			}
+		}
+
+		TArray<uint64> Bits;
+		Bits.SetNumZeroed(NumWords);
+		for (int32 Trial = 0; Trial < 64; Trial++)
+		{
+			//None, all, one pattern in the last word, then random sets of varying density
+			for (int32 Word = 0; Word < NumWords; Word++)
+			{
+				const uint64 Random64 = (static_cast<uint64>(Random.GetUnsignedInt()) << 32) | Random.GetUnsignedInt();
+				Bits[Word] = Trial == 0 ? 0 : Trial == 1 ? ~0ull : Trial == 2 ? 0 : Random64 & (Trial % 3 == 0 ? Random64 >> 7 : ~0ull);
+			}
+			if (Trial == 2)
+			{
+				Bits[NumWords - 1] = 1ull << (NumPatterns % 64 - 1);
+			}
+			Bits[NumWords - 1] &= (1ull << (NumPatterns % 64)) - 1;
+
+			uint8 Vector[FPatternBlock::NumBytes];
+			uint8 Scalar[FPatternBlock::NumBytes] = {};
+			TPattern<Size>::OrAllowed(PatternData.GetData(), Bits.GetData(), NumWords, Vector);
+			TPattern<Size>::OrAllowedScalar(PatternData.GetData(), Bits.GetData(), NumWords, Scalar);
+			if (FMemory::Memcmp(Vector, Scalar, FPatternBlock::NumBytes) != 0)
+			{
+				Test.AddError(FString::Printf(TEXT("OrAllowed differs from OrAllowedScalar for size %d, trial %d"), Size, Trial));
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSLPatternVectorMatchesScalarTest, "SLTilemap.Pattern.VectorMatchesScalar", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::SmokeFilter)
+
+bool FSLPatternVectorMatchesScalarTest::RunTest(const FString& Parameters)
+{
+	FRandomStream Random(1);
+	const bool bSize2 = TestPatternSize<2>(*this, Random);
+	const bool bSize3 = TestPatternSize<3>(*this, Random);
+	const bool bSize4 = TestPatternSize<4>(*this, Random);
+	return bSize2 && bSize3 && bSize4;
+}
+
+#endif
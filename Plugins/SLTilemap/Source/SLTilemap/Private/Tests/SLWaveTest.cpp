@@ -0,0 +1,299 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Misc/AutomationTest.h"
+#include "SLWave.h"
+
+//Friend of USLWave, reaches the solver state the public API doesn't show
+struct FSLWaveTestAccess
+{
+	//Everything RollBack must restore
+	struct FSnapshot
+	{
+		TArray<uint64> CellPatternBits;
+		TArray<int32> CellPatternCounts;
+		TArray<int32> CellSumWeights;
+		TArray<double> CellSumWeightLogWeights;
+		TArray<float> CellEntropyArray;
+		TArray<bool> CellIsObservedArray;
+		TArray<uint16> CellRemovedSupportCounts;
+		FEntropyHeap EntropyHeap;
+		TArray<uint8> OutputData;
+	};
+
+	static FSnapshot TakeSnapshot(const USLWave& Wave)
+	{
+		FSnapshot Snapshot;
+		Snapshot.CellPatternBits = Wave.CellPatternBits;
+		Snapshot.CellPatternCounts = Wave.CellPatternCounts;
+		Snapshot.CellSumWeights = Wave.CellSumWeights;
+		Snapshot.CellSumWeightLogWeights = Wave.CellSumWeightLogWeights;
+		Snapshot.CellEntropyArray = Wave.CellEntropyArray;
+		Snapshot.CellIsObservedArray = Wave.CellIsObservedArray;
+		//Cells without counters read as zero, where each cell's counters sit in the pool may change
+		const int32 NumCounts = Wave.Model->SupportCounts.Num();
+		Snapshot.CellRemovedSupportCounts.SetNumZeroed(Wave.CellSupportCountStarts.Num() * NumCounts);
+		for (int32 CellIndex = 0; CellIndex < Wave.CellSupportCountStarts.Num(); CellIndex++)
+		{
+			if (Wave.CellSupportCountStarts[CellIndex] != INDEX_NONE)
+			{
+				FMemory::Memcpy(&Snapshot.CellRemovedSupportCounts[CellIndex * NumCounts], &Wave.CellRemovedSupportCounts[Wave.CellSupportCountStarts[CellIndex]], NumCounts * sizeof(uint16));
+			}
+		}
+		Snapshot.EntropyHeap = Wave.EntropyHeap;
+		Snapshot.OutputData = Wave.OutputTileMap.Data;
+		return Snapshot;
+	}
+
+	static int32 GetNumDecisions(const USLWave& Wave)
+	{
+		return Wave.Decisions.Num();
+	}
+
+	//Contradicts the last decision by banning what is left in an unobserved cell, next to the decided one if possible.
+	//The bans stay unpropagated and the update queue is dropped, as Propagate leaves them on a contradiction, then the decision is rolled back like Backtrack does
+	static bool ForceContradictionAndRollBack(USLWave& Wave)
+	{
+		const FWaveDecision Decision = Wave.Decisions.Last();
+		int32 CellToBan = INDEX_NONE;
+		for (int32 CellIndex = 0; CellIndex < Wave.CellIsObservedArray.Num(); CellIndex++)
+		{
+			const FIntPoint Delta(Wave.CellXArray[CellIndex] - Wave.CellXArray[Decision.CellIndex], Wave.CellYArray[CellIndex] - Wave.CellYArray[Decision.CellIndex]);
+			if (!Wave.CellIsObservedArray[CellIndex] && (CellToBan == INDEX_NONE || FMath::Abs(Delta.X) + FMath::Abs(Delta.Y) == 1))
+			{
+				CellToBan = CellIndex;
+			}
+		}
+		if (CellToBan == INDEX_NONE)
+		{
+			return false;
+		}
+		for (int32 PatternIndex = 0; PatternIndex < Wave.Model->NumPatterns; PatternIndex++)
+		{
+			if (Wave.IsPatternAllowed(CellToBan, PatternIndex))
+			{
+				Wave.BanPattern(CellToBan, PatternIndex);
+			}
+		}
+		if (!Wave.Failed)
+		{
+			return false;
+		}
+		for (const int32 CellIndex : Wave.CellsToUpdate)
+		{
+			Wave.CellIsQueuedArray[CellIndex] = false;
+		}
+		Wave.CellsToUpdate.Reset();
+		Wave.Decisions.Pop(false);
+		Wave.RollBack(Decision);
+		Wave.Failed = false;
+		return true;
+	}
+};
+
+namespace
+{
+	//Quadrants of ground and void with one wall tile in a corner, so 2x2 windows come in very different counts
+	FTileMap MakeTestInput()
+	{
+		FTileMap TileMap(6, 6, static_cast<uint8>(ETileState::Void));
+		for (int32 Y = 0; Y < 3; Y++)
+		{
+			for (int32 X = 0; X < 3; X++)
+			{
+				TileMap.Data[USLTilemapLib::TileMapXYToIndex(TileMap, X, Y)] = static_cast<uint8>(ETileState::Ground);
+			}
+		}
+		TileMap.Data[USLTilemapLib::TileMapXYToIndex(TileMap, 5, 5)] = static_cast<uint8>(ETileState::Wall);
+		return TileMap;
+	}
+
+	template <typename ElementType>
+	bool AreBitwiseEqual(const TArray<ElementType>& A, const TArray<ElementType>& B)
+	{
+		return A.Num() == B.Num() && FMemory::Memcmp(A.GetData(), B.GetData(), A.Num() * sizeof(ElementType)) == 0;
+	}
+
+	//Heaps are equal if they pop the same indices in the same order, their layouts may differ
+	bool PopTheSame(FEntropyHeap A, FEntropyHeap B)
+	{
+		int32 IndexA = INDEX_NONE;
+		int32 IndexB = INDEX_NONE;
+		bool bPoppedA = A.Pop(IndexA);
+		bool bPoppedB = B.Pop(IndexB);
+		while (bPoppedA && bPoppedB && IndexA == IndexB)
+		{
+			bPoppedA = A.Pop(IndexA);
+			bPoppedB = B.Pop(IndexB);
+		}
+		return !bPoppedA && !bPoppedB;
+	}
+
+	//2x2 tiles packed into a key
+	uint32 PackWindow(const FTileMap& TileMap, const int32 X, const int32 Y)
+	{
+		uint32 Key = 0;
+		for (int32 j = 0; j < 2; j++)
+		{
+			for (int32 i = 0; i < 2; i++)
+			{
+				Key = Key << 8 | USLTilemapLib::GetTileAtXY(TileMap, X + i, Y + j);
+			}
+		}
+		return Key;
+	}
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSLWaveObservationMatchesCountsTest, "SLTilemap.Wave.ObservationMatchesCounts", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::SmokeFilter)
+
+bool FSLWaveObservationMatchesCountsTest::RunTest(const FString& Parameters)
+{
+	//Every window of the input is a pattern when Symmetry is 1, counted here independently of the wave
+	const FTileMap Input = MakeTestInput();
+	TMap<uint32, int32> Counts;
+	int32 SumCounts = 0;
+	for (int32 Y = 0; Y < Input.SizeY - 1; Y++)
+	{
+		for (int32 X = 0; X < Input.SizeX - 1; X++)
+		{
+			Counts.FindOrAdd(PackWindow(Input, X, Y))++;
+			SumCounts++;
+		}
+	}
+
+	//An output the size of one pattern is a single cell without neighbors, so each Step observes it with every pattern allowed
+	USLWave* Wave = NewObject<USLWave>();
+	Wave->InputTileMap = Input;
+	Wave->PatternSize = 2;
+	Wave->Symmetry = 1;
+	constexpr int32 NumTrials = 2000;
+	TMap<uint32, int32> Observed;
+	for (int32 Trial = 0; Trial < NumTrials; Trial++)
+	{
+		Wave->OutputTileMap = FTileMap(2, 2, 0xFF);
+		Wave->Seed = Trial;
+		if (!Wave->Initialize())
+		{
+			AddError(TEXT("Initialize failed"));
+			return false;
+		}
+		Wave->Step();
+		if (Wave->HasFailed() || Wave->GetProgress() != 1)
+		{
+			AddError(FString::Printf(TEXT("Trial %d did not observe the cell"), Trial));
+			return false;
+		}
+		Observed.FindOrAdd(PackWindow(Wave->OutputTileMap, 0, 0))++;
+	}
+
+	//Each pattern should come up in proportion to its count, within five standard deviations
+	for (const auto& Pair : Observed)
+	{
+		if (!Counts.Contains(Pair.Key))
+		{
+			AddError(FString::Printf(TEXT("Observed %08x, which is not a window of the input"), Pair.Key));
+		}
+	}
+	for (const auto& Pair : Counts)
+	{
+		const double Probability = static_cast<double>(Pair.Value) / SumCounts;
+		const double Expected = NumTrials * Probability;
+		const double Tolerance = 5 * FMath::Sqrt(NumTrials * Probability * (1 - Probability)) + 1;
+		const int32 NumObserved = Observed.FindRef(Pair.Key);
+		if (FMath::Abs(NumObserved - Expected) > Tolerance)
+		{
+			AddError(FString::Printf(TEXT("Pattern %08x with count %d was observed %d times, expected %.1f"), Pair.Key, Pair.Value, NumObserved, Expected));
+		}
+	}
+	return !HasAnyErrors();
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSLWaveRollBackRestoresStateTest, "SLTilemap.Wave.RollBackRestoresState", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::SmokeFilter)
+
+bool FSLWaveRollBackRestoresStateTest::RunTest(const FString& Parameters)
+{
+	USLWave* Wave = NewObject<USLWave>();
+	Wave->InputTileMap = MakeTestInput();
+	Wave->OutputTileMap = FTileMap(12, 12, 0xFF);
+	Wave->PatternSize = 2;
+	Wave->Seed = 1;
+	Wave->MaxBacktracks = 1000;
+	if (!Wave->Initialize())
+	{
+		AddError(TEXT("Initialize failed"));
+		return false;
+	}
+
+	//Every other Step is contradicted and rolled back, the ones between move the solve on
+	int32 NumRollBacks = 0;
+	for (int32 StepIndex = 0; !Wave->HasFailed(); StepIndex++)
+	{
+		const FSLWaveTestAccess::FSnapshot Before = FSLWaveTestAccess::TakeSnapshot(*Wave);
+		const int32 NumDecisions = FSLWaveTestAccess::GetNumDecisions(*Wave);
+		if (!Wave->Step())
+		{
+			break;
+		}
+		//Steps that backtracked by themselves decided something else than the snapshot saw
+		if (StepIndex % 2 == 1 || FSLWaveTestAccess::GetNumDecisions(*Wave) != NumDecisions + 1 || !FSLWaveTestAccess::ForceContradictionAndRollBack(*Wave))
+		{
+			continue;
+		}
+		NumRollBacks++;
+
+		const FSLWaveTestAccess::FSnapshot After = FSLWaveTestAccess::TakeSnapshot(*Wave);
+		TestTrue(FString::Printf(TEXT("Step %d restores CellPatternBits"), StepIndex), AreBitwiseEqual(Before.CellPatternBits, After.CellPatternBits));
+		TestTrue(FString::Printf(TEXT("Step %d restores CellPatternCounts"), StepIndex), AreBitwiseEqual(Before.CellPatternCounts, After.CellPatternCounts));
+		TestTrue(FString::Printf(TEXT("Step %d restores CellSumWeights"), StepIndex), AreBitwiseEqual(Before.CellSumWeights, After.CellSumWeights));
+		TestTrue(FString::Printf(TEXT("Step %d restores CellSumWeightLogWeights"), StepIndex), AreBitwiseEqual(Before.CellSumWeightLogWeights, After.CellSumWeightLogWeights));
+		TestTrue(FString::Printf(TEXT("Step %d restores CellEntropyArray"), StepIndex), AreBitwiseEqual(Before.CellEntropyArray, After.CellEntropyArray));
+		TestTrue(FString::Printf(TEXT("Step %d restores CellIsObservedArray"), StepIndex), Before.CellIsObservedArray == After.CellIsObservedArray);
+		TestTrue(FString::Printf(TEXT("Step %d restores CellRemovedSupportCounts"), StepIndex), AreBitwiseEqual(Before.CellRemovedSupportCounts, After.CellRemovedSupportCounts));
+		TestTrue(FString::Printf(TEXT("Step %d restores the entropy heap"), StepIndex), Before.EntropyHeap.Num() == After.EntropyHeap.Num() && PopTheSame(Before.EntropyHeap, After.EntropyHeap));
+		TestTrue(FString::Printf(TEXT("Step %d restores OutputTileMap"), StepIndex), AreBitwiseEqual(Before.OutputData, After.OutputData));
+		if (HasAnyErrors())
+		{
+			return false;
+		}
+	}
+	TestTrue(TEXT("Some decisions were rolled back"), NumRollBacks > 0);
+	return !HasAnyErrors();
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSLWaveBacktrackingKeepsOutputTest, "SLTilemap.Wave.BacktrackingKeepsOutput", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::SmokeFilter)
+
+bool FSLWaveBacktrackingKeepsOutputTest::RunTest(const FString& Parameters)
+{
+	//Journaling must not change the solve, so seeds that never contradict give the same output either way
+	int32 NumCompared = 0;
+	for (int32 Seed = 0; Seed < 16; Seed++)
+	{
+		USLWave* Waves[2];
+		bool Solved[2];
+		for (int32 i = 0; i < 2; i++)
+		{
+			Waves[i] = NewObject<USLWave>();
+			Waves[i]->InputTileMap = MakeTestInput();
+			Waves[i]->OutputTileMap = FTileMap(16, 16, 0xFF);
+			Waves[i]->PatternSize = 2;
+			Waves[i]->Seed = Seed;
+			Waves[i]->MaxBacktracks = i == 0 ? 0 : 8;
+			Solved[i] = Waves[i]->Run();
+		}
+		if (!Solved[0])
+		{
+			continue;
+		}
+		NumCompared++;
+		TestTrue(FString::Printf(TEXT("Seed %d solves with backtracking on"), Seed), Solved[1]);
+		TestEqual(FString::Printf(TEXT("Seed %d backtracks"), Seed), Waves[1]->GetBacktrackCount(), 0);
+		TestTrue(FString::Printf(TEXT("Seed %d gives the same output"), Seed), Waves[0]->OutputTileMap.Data == Waves[1]->OutputTileMap.Data);
+	}
+	TestTrue(TEXT("Some seeds solved without contradictions"), NumCompared > 0);
+	return !HasAnyErrors();
+}
+
+#endif
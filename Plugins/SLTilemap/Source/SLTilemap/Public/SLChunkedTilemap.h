@@ -0,0 +1,114 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "SLTilemapLib.h"
+#include "SLWave.h"
+#include "UObject/Object.h"
+#include "SLChunkedTilemap.generated.h"
+
+
+/**
+ * Unbounded tilemap solved by USLWave in ChunkSize x ChunkSize chunks on demand.
+ * Each chunk is loaded or solved on the thread pool, solves use an apron seeded from already solved neighbors so seams stay consistent,
+ * and chunks next to one being loaded, solved or saved wait for it. Chunks far from every streaming center are written to disk on the thread pool
+ * and dropped, so memory only depends on LoadRadius.
+ */
+UCLASS(BlueprintType)
+class SLTILEMAP_API USLChunkedTilemap : public UObject
+{
+	GENERATED_BODY()
+
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap")
+	FTileMap InputTileMap;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 2, ClampMax = 4))
+	int32 PatternSize = 3;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 1, ClampMax = 8))
+	int32 Symmetry = 8;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap")
+	int32 Seed = 0;
+	//Tiles per chunk side
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 4))
+	int32 ChunkSize = 64;
+	//Chunks kept loaded in every direction around each streaming center
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 0))
+	int32 LoadRadius = 2;
+	//Chunks loaded or started solving per UpdateStreaming call, 0 for no limit
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 0))
+	int32 MaxChunksPerUpdate = 1;
+	//Chunks loaded or solved on the thread pool at once
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 1))
+	int32 MaxChunkSolves = 4;
+	//Seeds tried per chunk before keeping a failed solve, which is never written to disk so it is solved again once evicted
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 1))
+	int32 MaxAttempts = 8;
+	//Where evicted chunks are written, defaults to Saved/TilemapChunks. Chunks found there are loaded instead of solved,
+	//including ones from earlier sessions, so clear it after changing InputTileMap, PatternSize, Symmetry, Seed or ChunkSize
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap")
+	FString ChunkDirectory;
+
+	//Adds chunks that finished loading or solving, starts loading or solving missing chunks around the given chunk coordinates, nearest first,
+	//and evicts the rest. Call it every frame, a chunk is loaded by the first call after its task finishes
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void UpdateStreaming(const TArray<FIntPoint>& CenterChunks);
+	//Writes every loaded chunk to disk, waiting for evicted chunks still being written
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void FlushToDisk();
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	bool IsChunkLoaded(const FIntPoint& Chunk) const;
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	bool GetChunk(const FIntPoint& Chunk, FTileMap& OutTileMap) const;
+	//True while the chunk is being loaded or solved
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	bool IsChunkSolving(const FIntPoint& Chunk) const;
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	FIntPoint TileToChunk(const int32 X, const int32 Y) const;
+	//Tile at world tile coordinates, 0 if its chunk isn't loaded and Void if it failed to solve
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	uint8 GetTileAtXY(const int32 X, const int32 Y) const;
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	int32 GetNumLoadedChunks() const;
+
+	//Begin UObject
+	virtual void BeginDestroy() override;
+	//End UObject
+
+private:
+	struct FChunkResult
+	{
+		FTileMap TileMap;
+		//False if every attempt failed, TileMap then holds the last one
+		bool bSolved = false;
+	};
+
+	struct FChunkSolve
+	{
+		USLWave* Wave = nullptr;
+		TFuture<FChunkResult> Result;
+	};
+
+	//Every wave created so far, solving or idle
+	UPROPERTY()
+	TArray<USLWave*> Waves;
+	TArray<USLWave*> IdleWaves;
+	TMap<FIntPoint, FChunkSolve> ChunkSolves;
+	//Evicted chunks being written, false if the write failed
+	TMap<FIntPoint, TFuture<bool>> ChunkSaves;
+	TMap<FIntPoint, FTileMap> LoadedChunks;
+	//Loaded chunks that failed to solve, kept off disk and out of their neighbors' aprons
+	TSet<FIntPoint> FailedChunks;
+
+	//Starts loading or else solving Chunk on the thread pool, false if it can't start yet
+	bool StartChunk(const FIntPoint& Chunk);
+	//Loads chunks whose tasks finished
+	void FinishChunkSolves();
+	void FinishChunkSaves(const bool bWait);
+	//True if Chunk or a neighbor is being loaded, solved or saved
+	bool IsNextToChunkTask(const FIntPoint& Chunk) const;
+	void EvictChunk(const FIntPoint& Chunk);
+	FString GetChunkPath(const FIntPoint& Chunk) const;
+};
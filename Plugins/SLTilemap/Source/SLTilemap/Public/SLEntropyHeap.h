@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Indexed binary min-heap of cell indices keyed on entropy.
+ * Keys can be raised or lowered in place, equal keys are ordered by a fixed tie break per index and then by index so pops are deterministic.
+ */
+class SLTILEMAP_API FEntropyHeap
+{
+public:
+	//Rebuild the heap holding every index in Keys, TieBreaks orders indices of equal keys and is kept for the heap's lifetime
+	void Build(const TArray<float>& Keys, const TArray<uint32>& TieBreaks);
+	void Empty();
+
+	//Insert Index, or move it if already present
+	void Update(const int32 Index, const float Key);
+	void Remove(const int32 Index);
+	//Pops the index with the lowest key, false if empty
+	bool Pop(int32& OutIndex);
+
+	bool Contains(const int32 Index) const;
+	int32 Num() const;
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	TArray<int32> Heap;
+	TArray<int32> HeapPositions;
+	TArray<float> HeapKeys;
+	TArray<uint32> HeapTieBreaks;
+
+	bool IsLess(const int32 A, const int32 B) const;
+	void SiftUp(int32 Position);
+	void SiftDown(int32 Position);
+	void SwapPositions(const int32 A, const int32 B);
+};
@@ -0,0 +1,247 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Pattern sizes USLWave has kernels for
+#define SL_MIN_PATTERN_SIZE 2
+#define SL_MAX_PATTERN_SIZE 4
+
+/**
+ * A pattern's tiles zero padded to one 16 byte block, so fit tests and OR merges are a few vector instructions.
+ * SSE and NEON where available, otherwise two 64 bit words.
+ */
+struct FPatternBlock
+{
+	static constexpr int32 NumBytes = 16;
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+	typedef uint8x16_t FRegister;
+
+	static FORCEINLINE FRegister Load(const uint8* Block)
+	{
+		return vld1q_u8(Block);
+	}
+
+	static FORCEINLINE void Store(uint8* Block, const FRegister Value)
+	{
+		vst1q_u8(Block, Value);
+	}
+
+	static FORCEINLINE FRegister Zero()
+	{
+		return vdupq_n_u8(0);
+	}
+
+	static FORCEINLINE FRegister Or(const FRegister A, const FRegister B)
+	{
+		return vorrq_u8(A, B);
+	}
+
+	//True if every bit set in Pattern is also set in Map
+	static FORCEINLINE bool Fits(const FRegister Pattern, const FRegister Map)
+	{
+		//Both halves of the compare are all ones, without vminvq_u8 which only AArch64 has
+		const uint64x2_t Equal = vreinterpretq_u64_u8(vceqq_u8(vandq_u8(Map, Pattern), Pattern));
+		return (vgetq_lane_u64(Equal, 0) & vgetq_lane_u64(Equal, 1)) == ~0ull;
+	}
+#elif PLATFORM_ENABLE_VECTORINTRINSICS
+	typedef __m128i FRegister;
+
+	static FORCEINLINE FRegister Load(const uint8* Block)
+	{
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(Block));
+	}
+
+	static FORCEINLINE void Store(uint8* Block, const FRegister Value)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(Block), Value);
+	}
+
+	static FORCEINLINE FRegister Zero()
+	{
+		return _mm_setzero_si128();
+	}
+
+	static FORCEINLINE FRegister Or(const FRegister A, const FRegister B)
+	{
+		return _mm_or_si128(A, B);
+	}
+
+	//True if every bit set in Pattern is also set in Map
+	static FORCEINLINE bool Fits(const FRegister Pattern, const FRegister Map)
+	{
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(Map, Pattern), Pattern)) == 0xFFFF;
+	}
+#else
+	struct FRegister
+	{
+		uint64 Words[2];
+	};
+
+	static FORCEINLINE FRegister Load(const uint8* Block)
+	{
+		FRegister Value;
+		FMemory::Memcpy(Value.Words, Block, NumBytes);
+		return Value;
+	}
+
+	static FORCEINLINE void Store(uint8* Block, const FRegister Value)
+	{
+		FMemory::Memcpy(Block, Value.Words, NumBytes);
+	}
+
+	static FORCEINLINE FRegister Zero()
+	{
+		return {{0, 0}};
+	}
+
+	static FORCEINLINE FRegister Or(const FRegister A, const FRegister B)
+	{
+		return {{A.Words[0] | B.Words[0], A.Words[1] | B.Words[1]}};
+	}
+
+	//True if every bit set in Pattern is also set in Map
+	static FORCEINLINE bool Fits(const FRegister Pattern, const FRegister Map)
+	{
+		return ((Map.Words[0] & Pattern.Words[0]) == Pattern.Words[0]) && ((Map.Words[1] & Pattern.Words[1]) == Pattern.Words[1]);
+	}
+#endif
+};
+
+/**
+ * Kernels for a square pattern of Size x Size tiles stored row by row.
+ * They work on raw tile pointers so patterns can sit back to back in one flat buffer, and never allocate.
+ * Fits and OrAllowed take patterns padded to an FPatternBlock, the Scalar versions are the tile by tile reference,
+ * compared against them by the SLTilemap.Pattern automation test.
+ */
+template <int32 Size>
+struct TPattern
+{
+	static constexpr int32 NumTiles = Size * Size;
+
+	//Out is In rotated a quarter turn, matching USLTilemapLib::RotateTilemap
+	static FORCEINLINE void Rotate(const uint8* In, uint8* Out)
+	{
+		for (int32 y = 0; y < Size; y++)
+		{
+			for (int32 x = 0; x < Size; x++)
+			{
+				Out[y * Size + x] = In[(Size - 1 - x) * Size + y];
+			}
+		}
+	}
+
+	//Out is In flipped along X, matching USLTilemapLib::MirrorTilemap
+	static FORCEINLINE void Mirror(const uint8* In, uint8* Out)
+	{
+		for (int32 y = 0; y < Size; y++)
+		{
+			for (int32 x = 0; x < Size; x++)
+			{
+				Out[y * Size + x] = In[y * Size + Size - 1 - x];
+			}
+		}
+	}
+
+	//True if every bit set in Pattern is also set in the map window starting at Map
+	static FORCEINLINE bool Fits(const uint8* Pattern, const uint8* Map, const int32 MapStride)
+	{
+		alignas(16) uint8 Window[FPatternBlock::NumBytes] = {};
+		for (int32 y = 0; y < Size; y++)
+		{
+			FMemory::Memcpy(&Window[y * Size], &Map[y * MapStride], Size);
+		}
+		const bool Result = FPatternBlock::Fits(FPatternBlock::Load(Pattern), FPatternBlock::Load(Window));
+		checkSlow(Result == FitsScalar(Pattern, Map, MapStride));
+		return Result;
+	}
+
+	static FORCEINLINE bool FitsScalar(const uint8* Pattern, const uint8* Map, const int32 MapStride)
+	{
+		for (int32 y = 0; y < Size; y++)
+		{
+			for (int32 x = 0; x < Size; x++)
+			{
+				const uint8 PatternTile = Pattern[y * Size + x];
+				if ((Map[y * MapStride + x] & PatternTile) != PatternTile)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	//Copies Pattern into the map window starting at Map
+	static FORCEINLINE void Write(const uint8* Pattern, uint8* Map, const int32 MapStride)
+	{
+		for (int32 y = 0; y < Size; y++)
+		{
+			FMemory::Memcpy(&Map[y * MapStride], &Pattern[y * Size], Size);
+		}
+	}
+
+	//Out is the bitwise OR of every pattern in PatternData whose bit is set in Bits, Out must hold a whole FPatternBlock
+	static FORCEINLINE void OrAllowed(const uint8* PatternData, const uint64* Bits, const int32 NumWords, uint8* Out)
+	{
+		FPatternBlock::FRegister Result = FPatternBlock::Zero();
+		for (int32 Word = 0; Word < NumWords; Word++)
+		{
+			uint64 WordBits = Bits[Word];
+			while (WordBits)
+			{
+				const int32 PatternIndex = Word * 64 + FMath::CountTrailingZeros64(WordBits);
+				WordBits &= WordBits - 1;
+				Result = FPatternBlock::Or(Result, FPatternBlock::Load(&PatternData[PatternIndex * FPatternBlock::NumBytes]));
+			}
+		}
+		FPatternBlock::Store(Out, Result);
+#if DO_GUARD_SLOW
+		uint8 Expected[NumTiles];
+		OrAllowedScalar(PatternData, Bits, NumWords, Expected);
+		checkSlow(FMemory::Memcmp(Out, Expected, NumTiles) == 0);
+#endif
+	}
+
+	static FORCEINLINE void OrAllowedScalar(const uint8* PatternData, const uint64* Bits, const int32 NumWords, uint8* Out)
+	{
+		uint8 Result[NumTiles] = {};
+		for (int32 Word = 0; Word < NumWords; Word++)
+		{
+			uint64 WordBits = Bits[Word];
+			while (WordBits)
+			{
+				const int32 PatternIndex = Word * 64 + FMath::CountTrailingZeros64(WordBits);
+				WordBits &= WordBits - 1;
+				const uint8* Pattern = &PatternData[PatternIndex * FPatternBlock::NumBytes];
+				for (int32 i = 0; i < NumTiles; i++)
+				{
+					Result[i] |= Pattern[i];
+				}
+			}
+		}
+		FMemory::Memcpy(Out, Result, NumTiles);
+	}
+
+	//True if B placed at (OffsetX, OffsetY) relative to A matches A wherever they overlap
+	static FORCEINLINE bool Agree(const uint8* A, const uint8* B, const int32 OffsetX, const int32 OffsetY)
+	{
+		const int32 MinX = FMath::Max(0, OffsetX);
+		const int32 MaxX = FMath::Min(Size, Size + OffsetX);
+		const int32 MinY = FMath::Max(0, OffsetY);
+		const int32 MaxY = FMath::Min(Size, Size + OffsetY);
+		for (int32 y = MinY; y < MaxY; y++)
+		{
+			for (int32 x = MinX; x < MaxX; x++)
+			{
+				if (A[y * Size + x] != B[(y - OffsetY) * Size + x - OffsetX])
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+};
@@ -5,6 +5,8 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+SLTILEMAP_API DECLARE_LOG_CATEGORY_EXTERN(LogSLTilemap, Log, All);
+
 class FSLTilemapModule : public IModuleInterface
 {
 public:
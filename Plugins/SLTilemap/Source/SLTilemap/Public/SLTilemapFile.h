@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SLTilemapLib.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+enum class ETileMapCompression : uint8
+{
+	None,
+	//Byte pairs of run length and tile, good for long runs of Void or Ground
+	RLE,
+	LZ4
+};
+
+/**
+ * Versioned binary file of named tilemaps, a header, a fixed size entry per map, the names, then the tile bytes.
+ * Files are memory mapped when the platform allows it, so tiles stored uncompressed are read in place without a parse or a copy.
+ * Fields are written in the platform's byte order, which is little endian everywhere we ship.
+ */
+class SLTILEMAP_API FTileMapFile
+{
+public:
+	static constexpr uint32 Magic = 0x4D544C53; //"SLTM"
+	static constexpr uint32 Version = 1;
+
+	FTileMapFile();
+	~FTileMapFile();
+
+	//Writes TileMaps to Path, keeping each one uncompressed if Compression wouldn't make it smaller
+	static bool Save(const FString& Path, const TArray<FString>& Names, const TArray<FTileMap>& TileMaps, const ETileMapCompression Compression = ETileMapCompression::None);
+	static bool Save(const FString& Path, const FTileMap& TileMap, const ETileMapCompression Compression = ETileMapCompression::None);
+	//Reads the first tilemap in Path
+	static bool Load(const FString& Path, FTileMap& OutTileMap);
+
+	//Maps Path and validates its header and entries, the file stays open until Close or destruction
+	bool Open(const FString& Path);
+	void Close();
+
+	int32 Num() const;
+	FString GetName(const int32 Index) const;
+	int32 Find(const FString& Name) const;
+	int32 GetSizeX(const int32 Index) const;
+	int32 GetSizeY(const int32 Index) const;
+	//Tiles of an uncompressed tilemap inside the mapped file, nullptr if it is compressed
+	const uint8* GetData(const int32 Index) const;
+	//Copies or decompresses a tilemap
+	bool GetTileMap(const int32 Index, FTileMap& OutTileMap) const;
+
+private:
+	struct FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		int32 NumTileMaps;
+		int32 Reserved;
+	};
+
+	struct FEntry
+	{
+		int64 DataOffset;
+		int32 DataSize;
+		int32 SizeX;
+		int32 SizeY;
+		int32 Compression;
+		int32 NameOffset;
+		int32 NameSize;
+	};
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	//Whole file when it couldn't be mapped
+	TArray<uint8> LoadedBytes;
+	const uint8* FileData = nullptr;
+	int64 FileSize = 0;
+	const FEntry* Entries = nullptr;
+	int32 NumEntries = 0;
+
+	bool Validate();
+	static void CompressRLE(const TArray<uint8>& Data, TArray<uint8>& OutBytes);
+	static bool DecompressRLE(const uint8* Bytes, const int32 NumBytes, TArray<uint8>& OutData);
+};
@@ -54,12 +54,117 @@ struct FTileMap : public FTableRowBase
 		Data = NewData;
 	}
 
+	//Copies and moves take the tiles but not the dirty state, a map with new contents is all dirty to its consumers
+	FTileMap(const FTileMap& Other)
+		: FTableRowBase(Other), SizeX(Other.SizeX), SizeY(Other.SizeY), Data(Other.Data)
+	{
+	}
+
+	FTileMap(FTileMap&& Other)
+		: FTableRowBase(Other), SizeX(Other.SizeX), SizeY(Other.SizeY), Data(MoveTemp(Other.Data))
+	{
+	}
+
+	FTileMap& operator=(const FTileMap& Other)
+	{
+		FTableRowBase::operator=(Other);
+		SizeX = Other.SizeX;
+		SizeY = Other.SizeY;
+		Data = Other.Data;
+		MarkAllDirty();
+		return *this;
+	}
+
+	FTileMap& operator=(FTileMap&& Other)
+	{
+		FTableRowBase::operator=(Other);
+		SizeX = Other.SizeX;
+		SizeY = Other.SizeY;
+		Data = MoveTemp(Other.Data);
+		MarkAllDirty();
+		return *this;
+	}
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Tilemap")
 	int32 SizeX;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Tilemap")
 	int32 SizeY;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Tilemap", meta = (Bitmask, BitmaskEnum = "ETileState"))
 	TArray<uint8> Data;
+
+	//Regions changed since their consumer last took them, Max is exclusive.
+	//Touching regions are merged, past MaxDirtyRegions they collapse into their bounds. Read them through GetDirtyRegions, which includes bAllDirty
+	TArray<FIntRect> DirtyRegions;
+	static constexpr int32 MaxDirtyRegions = 16;
+	//The whole map changed, kept as a flag so new maps don't allocate a region
+	bool bAllDirty = true;
+
+	void MarkDirty(const int32 X, const int32 Y, const int32 DirtySizeX, const int32 DirtySizeY)
+	{
+		if (bAllDirty)
+		{
+			return;
+		}
+		FIntRect Region(X, Y, X + DirtySizeX, Y + DirtySizeY);
+		for (const FIntRect& Dirty : DirtyRegions)
+		{
+			if (Dirty.Min.X <= Region.Min.X && Dirty.Min.Y <= Region.Min.Y && Region.Max.X <= Dirty.Max.X && Region.Max.Y <= Dirty.Max.Y)
+			{
+				return;
+			}
+		}
+		for (int32 i = 0; i < DirtyRegions.Num(); i++)
+		{
+			const FIntRect& Dirty = DirtyRegions[i];
+			if (Region.Min.X <= Dirty.Max.X && Dirty.Min.X <= Region.Max.X && Region.Min.Y <= Dirty.Max.Y && Dirty.Min.Y <= Region.Max.Y)
+			{
+				//The grown region may now touch regions already checked
+				Region.Union(Dirty);
+				DirtyRegions.RemoveAtSwap(i);
+				i = -1;
+			}
+		}
+		DirtyRegions.Add(Region);
+		if (DirtyRegions.Num() > MaxDirtyRegions)
+		{
+			for (const FIntRect& Dirty : DirtyRegions)
+			{
+				Region.Union(Dirty);
+			}
+			DirtyRegions.Reset();
+			DirtyRegions.Add(Region);
+		}
+	}
+
+	void MarkAllDirty()
+	{
+		DirtyRegions.Reset();
+		bAllDirty = true;
+	}
+
+	void ClearDirty()
+	{
+		DirtyRegions.Reset();
+		bAllDirty = false;
+	}
+
+	bool IsDirty() const
+	{
+		return bAllDirty || DirtyRegions.Num() > 0;
+	}
+
+	TArray<FIntRect> GetDirtyRegions() const
+	{
+		return bAllDirty ? TArray<FIntRect>{FIntRect(0, 0, SizeX, SizeY)} : DirtyRegions;
+	}
+
+	//GetDirtyRegions, then ClearDirty
+	TArray<FIntRect> TakeDirtyRegions()
+	{
+		TArray<FIntRect> Regions = bAllDirty ? TArray<FIntRect>{FIntRect(0, 0, SizeX, SizeY)} : MoveTemp(DirtyRegions);
+		ClearDirty();
+		return Regions;
+	}
 };
 
 FORCEINLINE bool operator ==(const FTileMap& A, const FTileMap& B)
@@ -68,6 +173,33 @@ FORCEINLINE bool operator ==(const FTileMap& A, const FTileMap& B)
 	return A.SizeX == B.SizeX && A.Data == B.Data;
 }
 
+//Rectangle of tiles as Blueprints see it
+USTRUCT(BlueprintType)
+struct FTileMapRegion
+{
+	GENERATED_BODY()
+	FTileMapRegion()
+	{
+	}
+
+	FTileMapRegion(const FIntRect& Rect)
+	{
+		X = Rect.Min.X;
+		Y = Rect.Min.Y;
+		SizeX = Rect.Width();
+		SizeY = Rect.Height();
+	}
+
+	UPROPERTY(BlueprintReadOnly, Category = "Tilemap")
+	int32 X = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Tilemap")
+	int32 Y = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Tilemap")
+	int32 SizeX = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Tilemap")
+	int32 SizeY = 0;
+};
+
 
 UCLASS()
 class SLTILEMAP_API USLTilemapLib : public UBlueprintFunctionLibrary
@@ -98,8 +230,16 @@ public:
 	static uint8 GetTileAtXY(const FTileMap& TileMap, const int32 X, const int32 Y);
 	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
 	static UTexture2D* TileMapToTexture(UPARAM(ref) FTileMap& TileMap);
+	//Uploads only the tiles in TileMap's dirty regions into Texture and clears them, creates a new texture if Texture is null or of another size.
+	//Keep the returned texture and pass it back in every time the tilemap changes
+	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
+	static UTexture2D* UpdateTileMapTexture(UPARAM(ref) FTileMap& TileMap, UTexture2D* Texture);
+	//Uploads Regions of TileMap into Texture, which must match its size
+	static void UpdateTileMapTextureRegions(const FTileMap& TileMap, UTexture2D* Texture, const TArray<FIntRect>& Regions);
 	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
 	static FColor TileToColor(const uint8 Tile);
+	//TileToColor of every tile value, computed once
+	static const FColor* GetTileColorTable();
 	UFUNCTION(BlueprintPure, Category = "SLTileMap")
 	static FTileMap MirrorTilemap(const FTileMap& TileMap);
 	UFUNCTION(BlueprintPure, Category = "SLTileMap")
@@ -108,4 +248,28 @@ public:
 	static bool IsTilemapValid(const FTileMap& TileMap);
 	UFUNCTION(BlueprintPure, Category = "SLTileMap")
 	static FTileMap GetTilemapSection(const FTileMap& TileMap, const int32 X, const int32 Y, const int32 SectionSizeX, const int32 SectionSizeY);
+
+	//Region operations work a row at a time and clip to the tilemap, so any rectangle is safe to pass
+	//Tiles of TileMap in the rectangle, tiles outside TileMap come back as None
+	UFUNCTION(BlueprintPure, Category = "SLTileMap")
+	static FTileMap CopyRegion(const FTileMap& TileMap, const int32 X, const int32 Y, const int32 RegionSizeX, const int32 RegionSizeY);
+	//Writes Source into TileMap with its corner at X, Y. With bSkipNone, None tiles of Source leave TileMap unchanged
+	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
+	static void PasteRegion(UPARAM(ref) FTileMap& TileMap, const FTileMap& Source, const int32 X, const int32 Y, const bool bSkipNone = false);
+	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
+	static void FillRegion(UPARAM(ref) FTileMap& TileMap, const uint8 Tile, const int32 X, const int32 Y, const int32 RegionSizeX, const int32 RegionSizeY);
+	//Replaces the 4-connected area of tiles equal to the one at X, Y with Tile, returns how many tiles changed
+	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
+	static int32 FloodFill(UPARAM(ref) FTileMap& TileMap, const uint8 Tile, const int32 X, const int32 Y);
+	//Swaps tiles within each row without allocating, then marks TileMap all dirty
+	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
+	static void MirrorTilemapInPlace(UPARAM(ref) FTileMap& TileMap);
+	//Rotates square tilemaps in place by cycling tiles four at a time, other sizes go through a scratch copy since their rows change length.
+	//Marks TileMap all dirty
+	UFUNCTION(BlueprintCallable, Category = "SLTileMap")
+	static void RotateTilemapInPlace(UPARAM(ref) FTileMap& TileMap);
+
+private:
+	//Part of the rectangle inside TileMap, empty if they don't overlap
+	static FIntRect ClipToTileMap(const FTileMap& TileMap, const int32 X, const int32 Y, const int32 RegionSizeX, const int32 RegionSizeY);
 };
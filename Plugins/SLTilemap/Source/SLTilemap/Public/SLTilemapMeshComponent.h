@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Components/SceneComponent.h"
+#include "SLTilemapLib.h"
+#include "SLTilemapMeshComponent.generated.h"
+
+class UHierarchicalInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/**
+ * Renders an FTileMap as hierarchical instanced static meshes, one component for the whole map per tile state.
+ * Each chunk owns a range of instances in every component, with some hidden spare instances to grow into,
+ * so an edit only rewrites the ranges of the chunks it touches. A component is only laid out again when a chunk outgrows its range.
+ * Instance transforms of changed chunks are built on a worker thread and swapped in once ready.
+ */
+UCLASS(ClassGroup = (SLTilemap), meta = (BlueprintSpawnableComponent))
+class SLTILEMAP_API USLTilemapMeshComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+
+public:
+	static constexpr int32 NumTileStates = 8;
+
+	USLTilemapMeshComponent();
+
+	//Mesh placed on every tile of a state, tiles without a mesh or with several states (unsolved) stay empty
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap")
+	TMap<ETileState, UStaticMesh*> TileMeshes;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 1))
+	float TileSize = 100;
+	//Tiles per chunk side, chunks are the unit of rebuilds and don't add draw calls
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SLTilemap", meta = (ClampMin = 1))
+	int32 ChunkSize = 64;
+	//Shows USLTilemapSubsystem's OutputTileMap and follows its OnTilemapChanged
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SLTilemap")
+	bool bFollowTilemapSubsystem = true;
+
+	//Begin ActorComponent
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	//End ActorComponent
+
+	//Rebuilds the chunks whose tiles differ from the current map, or every chunk if the size changed
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void SetTileMap(const FTileMap& NewTileMap);
+	//Rebuilds only the chunks overlapping Regions, the signature of USLTilemapSubsystem::OnTilemapChanged
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void UpdateTileMapRegions(const FTileMap& NewTileMap, const TArray<FTileMapRegion>& Regions);
+	//Rebuilds every chunk, needed after changing TileMeshes or TileSize
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void RebuildAll();
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	bool IsBuilding() const;
+
+private:
+	struct FChunkInstances
+	{
+		FIntPoint Chunk;
+		TArray<FTransform> Transforms[NumTileStates];
+	};
+
+	//Instances [Start, Start + Capacity) of a state's component, the ones past the chunk's tiles are hidden
+	struct FInstanceRange
+	{
+		int32 Start = 0;
+		int32 Capacity = 0;
+	};
+
+	FTileMap TileMap;
+	//One per ETileState flag, null until the map has had a tile of that state
+	UPROPERTY()
+	TArray<UHierarchicalInstancedStaticMeshComponent*> StateComponents;
+	TMap<FIntPoint, FInstanceRange> ChunkRanges[NumTileStates];
+	//Latest transforms of every chunk, to lay a component out again without rebuilding the chunks that didn't change
+	TMap<FIntPoint, FChunkInstances> ChunkTransforms;
+	TSet<FIntPoint> DirtyChunks;
+	//At most one build runs at a time, chunks dirtied meanwhile go in the next one
+	TFuture<TArray<FChunkInstances>> BuildTask;
+	bool DiscardBuild = false;
+
+	void MarkChunksDirty(const FIntRect& Region);
+	void StartBuild();
+	void ApplyBuild(const TArray<FChunkInstances>& Builds);
+	void LayoutState(const int32 StateIndex, UStaticMesh* Mesh);
+	void DestroyComponents();
+	FTransform GetHiddenTransform(const FIntPoint& Chunk) const;
+	static void BuildChunk(const FTileMap& Tiles, const int32 InChunkSize, const float InTileSize, FChunkInstances& OutInstances);
+};
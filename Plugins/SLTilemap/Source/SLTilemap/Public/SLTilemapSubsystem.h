@@ -9,9 +9,12 @@
 #include "SLTilemapSubsystem.generated.h"
 
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnTilemapGenerated, bool, bSuccess, const FTileMap&, TileMap);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnTilemapChanged, const FTileMap&, TileMap, const TArray<FTileMapRegion>&, Regions);
+
 
 UCLASS()
-class SLTILEMAP_API USLTilemapSubsystem : public UWorldSubsystem
+class SLTILEMAP_API USLTilemapSubsystem : public UTickableWorldSubsystem
 {
 	GENERATED_BODY()
 
@@ -22,17 +25,53 @@ public:
 	virtual void Deinitialize() override;
 	//End Subsystem
 
+	//Begin Tickable
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	//End Tickable
+
 
 	UPROPERTY(BlueprintReadWrite, Category = "SLTilemap")
 	FTileMap InputTileMap;
+	//Edits through SetTileAtXY are reported by OnTilemapChanged
 	UPROPERTY(BlueprintReadWrite, Category = "SLTilemap")
 	FTileMap OutputTileMap;
 	UPROPERTY(BlueprintReadOnly, Category = "SLTilemap")
 	USLWave* Wave;
 
-	
-	
-	
+	//Broadcast on the game thread when a GenerateAsync call finishes, bSuccess is false if it failed or was cancelled
+	UPROPERTY(BlueprintAssignable, Category = "SLTilemap")
+	FOnTilemapGenerated OnTilemapGenerated;
+	//Broadcast at most once per frame with the regions of OutputTileMap changed since the last broadcast
+	UPROPERTY(BlueprintAssignable, Category = "SLTilemap")
+	FOnTilemapChanged OnTilemapChanged;
+	//Broadcast at most once per frame with the regions of Wave's OutputTileMap written since the last broadcast, such as by Steps run on the game thread.
+	//Not broadcast while GenerateAsync runs, OnTilemapGenerated reports that
+	UPROPERTY(BlueprintAssignable, Category = "SLTilemap")
+	FOnTilemapChanged OnWaveChanged;
+
+	//Runs Wave on a background task, Wave must not be touched until OnTilemapGenerated fires
+	//NumRuns above 1 solves that many seeds in parallel and keeps the first success
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	bool GenerateAsync(const FTileMap& NewInputTileMap, const FTileMap& NewOutputTileMap, const int32 Seed, const int32 NumRuns = 1);
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void CancelGeneration();
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	bool IsGenerating() const;
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	float GetGenerationProgress() const;
+	//Texture of OutputTileMap, updated with the changed regions before OnTilemapChanged fires
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	UTexture2D* GetOutputTexture();
+
+
 private:
-	
+	bool Generating = false;
+	TFuture<void> GenerationTask;
+	UPROPERTY()
+	UTexture2D* OutputTexture = nullptr;
+
+	void OnGenerationFinished(const bool bSuccess);
+	//Broadcasts OnWaveChanged with the regions Wave wrote since the last call
+	void ReportWaveChanges();
 };
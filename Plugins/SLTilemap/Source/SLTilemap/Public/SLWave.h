@@ -3,27 +3,135 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "SLEntropyHeap.h"
+#include "SLPattern.h"
 #include "SLTilemapLib.h"
 #include "UObject/Object.h"
 #include "SLWave.generated.h"
 
 
-USTRUCT(BlueprintType)
-struct FCell
+struct FPatternBan
 {
-	GENERATED_BODY()
-	FCell()
+	FPatternBan()
 	{
 	}
-	FCell(const TArray<int32> NewAllowedPatternIndices, const TArray<int32> NewNeighborIndices)
+	FPatternBan(const int32 NewCellIndex, const int32 NewPatternIndex)
 	{
-		AllowedPatternIndices = NewAllowedPatternIndices;
-		NeighborIndices = NewNeighborIndices;
+		CellIndex = NewCellIndex;
+		PatternIndex = NewPatternIndex;
 	}
-	TArray<int32> AllowedPatternIndices;
-	TArray<int32> NeighborIndices;
+	int32 CellIndex = INDEX_NONE;
+	int32 PatternIndex = INDEX_NONE;
 };
 
+//OutputTileMap window at X, Y before it was overwritten, kept so backtracking can restore it
+struct FMapWrite
+{
+	int32 X = 0;
+	int32 Y = 0;
+	uint8 Tiles[FPatternBlock::NumBytes];
+};
+
+//An observation backtracking can return to, with the journal lengths from just before it
+struct FWaveDecision
+{
+	FWaveDecision()
+	{
+	}
+	FWaveDecision(const int32 NewCellIndex, const int32 NewPatternIndex, const int32 NewBanJournalNum, const int32 NewMapWriteJournalNum)
+	{
+		CellIndex = NewCellIndex;
+		PatternIndex = NewPatternIndex;
+		BanJournalNum = NewBanJournalNum;
+		MapWriteJournalNum = NewMapWriteJournalNum;
+	}
+	int32 CellIndex = INDEX_NONE;
+	int32 PatternIndex = INDEX_NONE;
+	int32 BanJournalNum = 0;
+	int32 MapWriteJournalNum = 0;
+};
+//Pattern tiles packed row by row into a fixed size key, used to deduplicate patterns while generating them
+struct FPatternKey
+{
+	static constexpr int32 MaxTiles = SL_MAX_PATTERN_SIZE * SL_MAX_PATTERN_SIZE;
+	static_assert(MaxTiles <= FPatternBlock::NumBytes, "Patterns must fit in one FPatternBlock");
+
+	FPatternKey()
+	{
+		FMemory::Memzero(Tiles, MaxTiles);
+	}
+
+	uint8 Tiles[MaxTiles];
+
+	bool operator==(const FPatternKey& Other) const
+	{
+		return FMemory::Memcmp(Tiles, Other.Tiles, MaxTiles) == 0;
+	}
+
+	friend uint32 GetTypeHash(const FPatternKey& Key)
+	{
+		uint64 Halves[2];
+		FMemory::Memcpy(Halves, Key.Tiles, MaxTiles);
+		return HashCombine(GetTypeHash(Halves[0]), GetTypeHash(Halves[1]));
+	}
+};
+
+//Immutable pattern tables for one input, shared between waves solving it
+struct FWaveModel
+{
+	FTileMap InputTileMap;
+	int32 PatternSize = 3;
+	int32 Symmetry = 8;
+
+	//Pattern tiles stored back to back, each zero padded to an FPatternBlock
+	int32 NumPatterns = 0;
+	TArray<uint8> PatternData;
+	TArray<int32> Counts;
+	TArray<float> Probabilities;
+	TArray<float> PlogP;
+	//Count * log2(Count) rounded so sums of it are exact, the pattern's share of a cell's running entropy sums
+	TArray<double> WeightLogWeights;
+
+	//Propagator, patterns allowed next to each pattern in each direction, flattened as [Direction][Pattern] -> list
+	TArray<int32> PropagatorStarts;
+	TArray<int32> PropagatorPatterns;
+	//Per [Pattern][Direction], number of patterns in the neighbor opposite Direction that allow Pattern when nothing is banned
+	TArray<uint16> SupportCounts;
+
+	const uint8* GetPattern(const int32 PatternIndex) const
+	{
+		return &PatternData[PatternIndex * FPatternBlock::NumBytes];
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return InputTileMap.Data.GetAllocatedSize() + PatternData.GetAllocatedSize() + Counts.GetAllocatedSize() + Probabilities.GetAllocatedSize() + PlogP.GetAllocatedSize()
+			+ WeightLogWeights.GetAllocatedSize() + PropagatorStarts.GetAllocatedSize() + PropagatorPatterns.GetAllocatedSize() + SupportCounts.GetAllocatedSize();
+	}
+};
+
+//Timings and counters for the last Initialize and the Steps after it
+USTRUCT(BlueprintType)
+struct FWaveStats
+{
+	GENERATED_BODY()
+	//0 when Initialize reused the pattern tables from an earlier run
+	UPROPERTY(BlueprintReadOnly, Category = "SLTilemap")
+	double GeneratePatternsMs = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SLTilemap")
+	double InitializeMs = 0;
+	//Summed over every Step, including the one that found a contradiction
+	UPROPERTY(BlueprintReadOnly, Category = "SLTilemap")
+	double StepMs = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SLTilemap")
+	int32 NumSteps = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SLTilemap")
+	int32 NumPatterns = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SLTilemap")
+	int32 NumCells = 0;
+};
 
 
 UCLASS()
@@ -39,40 +147,167 @@ public:
 	FTileMap InputTileMap;
 	UPROPERTY(BlueprintReadWrite, Category = "SLTilemap")
 	FTileMap OutputTileMap;
-	
+	//Width and height of the patterns read from InputTileMap
+	UPROPERTY(BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 2, ClampMax = 4))
+	int32 PatternSize = 3;
+	//How many of the 8 rotations and reflections of each input window become patterns, 1 uses windows as authored, 2 adds their mirror images
+	UPROPERTY(BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 1, ClampMax = 8))
+	int32 Symmetry = 8;
+	//Seeds the random order of cells of equal entropy
+	UPROPERTY(BlueprintReadWrite, Category = "SLTilemap")
+	int32 Seed = 0;
+	//Contradictions per Run undone by rolling back to the last observation and banning its pattern, 0 fails on the first one.
+	//Above 0 every ban and map write of the run is journaled
+	UPROPERTY(BlueprintReadWrite, Category = "SLTilemap", meta = (ClampMin = 0))
+	int32 MaxBacktracks = 0;
+
+	//Generates the pattern tables for InputTileMap, PatternSize and Symmetry unless the wave already has them, Initialize calls it
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	bool PrepareModel();
 	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
 	bool Initialize();
 	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
 	bool Step();
 	UFUNCTION(Blueprintcallable, Category = "SLTilemap")
 	bool Run();
-	
+	//Solves NumRuns copies of this wave with consecutive seeds in parallel, keeping the first to succeed along with its solver state.
+	//If none does, OutputTileMap is put back as it was and the wave is failed
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	bool RunSpeculative(const int32 NumRuns);
+	//Creates the extra waves RunSpeculative needs, game thread only, so required before running it on another thread
+	void PrepareSpeculativeRuns(const int32 NumRuns);
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	bool HasFailed() const;
+	//Thread safe, makes a Run in progress on another thread stop after its current Step.
+	//A Cancel made while no Run is in progress stops the next one, unless ClearCancel is called before it starts
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void Cancel();
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	void ClearCancel();
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	bool IsCancelled() const;
+	//Thread safe, fraction of cells observed so far
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	float GetProgress() const;
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	FWaveStats GetStats() const;
+	//Contradictions rolled back so far in the current Run
+	UFUNCTION(BlueprintPure, Category = "SLTilemap")
+	int32 GetBacktrackCount() const;
+	//Bytes currently held by the solver state and pattern tables, journals included
+	SIZE_T GetAllocatedSize() const;
+	//Uploads the tiles written since the last call, cheap enough to call after every Step.
+	//The subsystem's Wave reports its writes through USLTilemapSubsystem::OnWaveChanged instead
+	UFUNCTION(BlueprintCallable, Category = "SLTilemap")
+	UTexture2D* UpdateOutputTexture(UTexture2D* Texture);
+
 private:
+	//Automation tests inspect the solver state through this
+	friend struct FSLWaveTestAccess;
+
 	//Wave
-	int32 PatternSize = 3;
-	TArray<FTileMap> Patterns;
-	TArray<int32> Counts;
-	TArray<float> Probabilities;
-	TArray<float> PlogP;
+	TSharedPtr<const FWaveModel, ESPMode::ThreadSafe> Model;
+	UPROPERTY()
+	TArray<USLWave*> SpeculativeWaves;
+	FThreadSafeCounter ActiveSpeculativeRuns;
 	bool Failed = false;
 	int32 FailedAtIndex = 0;
+	FThreadSafeBool CancelRequested;
+	FThreadSafeCounter ObservedCellCount;
+	FThreadSafeCounter TotalCellCount;
+	FWaveStats Stats;
 
-	//Cells
-	TArray<FCell> CellArray;
+	//Cells, indexed row by row over WaveSizeX x WaveSizeY
+	int32 WaveSizeX = 0;
+	int32 WaveSizeY = 0;
 	TArray<int32> CellXArray;
 	TArray<int32> CellYArray;
 	TArray<float> CellEntropyArray;
+	//Random per cell, orders cells of equal entropy
+	TArray<uint32> CellTieBreakArray;
 	TArray<bool> CellIsObservedArray;
-	
+	//Unobserved cells keyed on entropy, ties broken by CellTieBreakArray
+	FEntropyHeap EntropyHeap;
+	FRandomStream RandomStream;
+
+	//Cell pattern state, one bit per pattern packed into WordsPerCell words per cell
+	int32 WordsPerCell = 0;
+	TArray<uint64> CellPatternBits;
+	TArray<int32> CellPatternCounts;
+	//Running sums over allowed patterns of Count and Count * log2(Count), decremented on each ban
+	TArray<int32> CellSumWeights;
+	TArray<double> CellSumWeightLogWeights;
+	//Per [Pattern][Direction] of a cell, how many of the model's SupportCounts have been banned, starting at the cell's entry in CellSupportCountStarts.
+	//Only unobserved cells that a ban has reached have counters, so the pool grows with the frontier of the solve rather than the wave
+	TArray<uint16> CellRemovedSupportCounts;
+	TArray<int32> CellSupportCountStarts;
+	//Counters of cells observed since, reused before the pool grows
+	TArray<int32> FreeSupportCountStarts;
+
+	//Propagation, bans are appended to BanJournal and propagated from NextBanToPropagate on
+	TArray<FPatternBan> BanJournal;
+	int32 NextBanToPropagate = 0;
+	//Cells that lost patterns this propagation, each listed once and updated after the bans are propagated
+	TArray<int32> CellsToUpdate;
+	TArray<bool> CellIsQueuedArray;
+
+	//Backtracking
+	TArray<FMapWrite> MapWriteJournal;
+	TArray<FWaveDecision> Decisions;
+	int32 BacktrackCount = 0;
+
+	//Bounds of the OutputTileMap writes since the last Propagate, which marks them dirty once instead of every write doing it.
+	//Inverted while there are none, so the first write sets it
+	FIntRect PendingDirtyRect = FIntRect(MAX_int32, MAX_int32, MIN_int32, MIN_int32);
+
+	bool CanSolve() const;
+	bool HasModelForInput() const;
+	//Makes this wave continue from where Other stopped, used when a speculative run other than this wave's own wins
+	void TakeSolverState(USLWave& Other);
 	void GeneratePatterns();
 	void InitPatternCells();
-	void RegisterPattern(const FTileMap& Pattern);
-	bool UpdateCell(const int32 CellIndex);
+	static void RegisterPattern(FWaveModel& NewModel, TMap<FPatternKey, int32>& PatternIndices, const FPatternKey& Pattern);
+	int32 GetNeighborIndex(const int32 CellIndex, const int32 Direction) const;
+	bool IsPatternAllowed(const int32 CellIndex, const int32 PatternIndex) const;
+	void BanPattern(const int32 CellIndex, const int32 PatternIndex);
+	void UpdateCellEntropy(const int32 CellIndex);
+	bool IsBacktracking() const;
 	void OnFailed();
+	void MarkCellObserved(const int32 CellIndex);
+	void AddPendingDirtyRect(const int32 X, const int32 Y, const int32 Size);
+	void MarkPendingDirtyRect();
+	//True if the neighbor in Direction still has a pattern allowing PatternIndex in this cell, read from its bits
+	bool IsPatternSupported(const int32 CellIndex, const int32 PatternIndex, const int32 Direction) const;
+	void AddSupportCounts(const int32 CellIndex);
+	void RemoveSupportCounts(const int32 CellIndex);
+	//Gives a cell counters matching its neighbors' bits, for cells rolled back to unobserved
+	void RebuildSupportCounts(const int32 CellIndex);
+	//Undoes every ban and map write made since Decision, leaving the state exactly as it was before its observation
+	void RollBack(const FWaveDecision& Decision);
+
+	//Compiled once per pattern size and chosen by Initialize, Step and GeneratePatterns, so the pattern kernels inline into the loops
+	template <int32 Size>
+	void GeneratePatternsWithPatternSize();
+	template <int32 Size>
+	static void BuildPropagator(FWaveModel& NewModel);
+	template <int32 Size>
+	void BanUnfitPatterns();
+	template <int32 Size>
+	bool StepWithPatternSize();
+	template <int32 Size>
+	void Propagate();
+	template <int32 Size>
+	void UpdateCell(const int32 CellIndex);
+	template <int32 Size>
+	bool Backtrack();
+	template <int32 Size>
 	void ObserveCell(const int32 CellIndex);
-	void WritePatternToMapData(const FTileMap& Pattern, int32 x, int32 y);
-	bool CanPatternFitAtThisLocation(const FTileMap& Pattern, int32 x, int32 y) const;
-	FTileMap OrCellPatternsTogether(const int32 CellIndex);	
+	template <int32 Size>
+	void WritePatternToMapData(const uint8* Pattern, int32 x, int32 y);
+	template <int32 Size>
+	bool CanPatternFitAtThisLocation(const uint8* Pattern, int32 x, int32 y) const;
+	template <int32 Size>
+	void OrCellPatternsTogether(const int32 CellIndex, uint8* OutPattern) const;
+
 
-	
 };
@@ -0,0 +1,299 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SLTilemapBenchmarkCommandlet.h"
+#include "SLTilemap.h"
+#include "SLWave.h"
+#include "Dom/JsonObject.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+
+namespace
+{
+	//Memory taken by a phase, as the wave reports it and as the platform sees it for the whole process
+	struct FMemoryDelta
+	{
+		int64 SolverBytes = 0;
+		int64 UsedPhysicalBytes = 0;
+
+		FMemoryDelta operator-(const FMemoryDelta& Other) const
+		{
+			return FMemoryDelta{SolverBytes - Other.SolverBytes, UsedPhysicalBytes - Other.UsedPhysicalBytes};
+		}
+		FMemoryDelta& operator+=(const FMemoryDelta& Other)
+		{
+			SolverBytes += Other.SolverBytes;
+			UsedPhysicalBytes += Other.UsedPhysicalBytes;
+			return *this;
+		}
+	};
+
+	FMemoryDelta GetMemory(const USLWave& Wave)
+	{
+		return FMemoryDelta{static_cast<int64>(Wave.GetAllocatedSize()), static_cast<int64>(FPlatformMemory::GetStats().UsedPhysical)};
+	}
+
+	void SetMemoryFields(FJsonObject& Case, const FString& Phase, const FMemoryDelta& Delta, const int64 Divisor)
+	{
+		Case.SetNumberField(FString::Printf(TEXT("Mean%sSolverBytes"), *Phase), static_cast<double>(Delta.SolverBytes) / Divisor);
+		Case.SetNumberField(FString::Printf(TEXT("Mean%sUsedPhysicalBytes"), *Phase), static_cast<double>(Delta.UsedPhysicalBytes) / Divisor);
+	}
+}
+
+
+USLTilemapBenchmarkCommandlet::USLTilemapBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USLTilemapBenchmarkCommandlet::Main(const FString& Params)
+{
+	FString CorpusPath = FPaths::ProjectDir() / TEXT("Assets/BenchmarkCorpus.json");
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks/SLTilemapBenchmark.json");
+	FString SizesString = TEXT("32,64");
+	FString BaselinePath;
+	int32 NumSeeds = 8;
+	int32 PatternSize = 3;
+	int32 Symmetry = 8;
+	int32 MaxBacktracks = 0;
+	float Tolerance = 0.2f;
+	FParse::Value(*Params, TEXT("Corpus="), CorpusPath);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	FParse::Value(*Params, TEXT("Sizes="), SizesString);
+	FParse::Value(*Params, TEXT("Baseline="), BaselinePath);
+	FParse::Value(*Params, TEXT("Seeds="), NumSeeds);
+	FParse::Value(*Params, TEXT("PatternSize="), PatternSize);
+	FParse::Value(*Params, TEXT("Symmetry="), Symmetry);
+	FParse::Value(*Params, TEXT("MaxBacktracks="), MaxBacktracks);
+	FParse::Value(*Params, TEXT("Tolerance="), Tolerance);
+
+	TArray<FString> Names;
+	TArray<FTileMap> TileMaps;
+	if (!LoadCorpus(CorpusPath, Names, TileMaps))
+	{
+		UE_LOG(LogSLTilemap, Error, TEXT("Could not read benchmark corpus %s"), *CorpusPath);
+		return 1;
+	}
+	TArray<FString> SizeStrings;
+	SizesString.ParseIntoArray(SizeStrings, TEXT(","));
+
+	TArray<TSharedPtr<FJsonValue>> Cases;
+	for (int32 i = 0; i < TileMaps.Num(); i++)
+	{
+		for (const FString& SizeString : SizeStrings)
+		{
+			const int32 Size = FCString::Atoi(*SizeString);
+			const TSharedPtr<FJsonObject> Case = RunCase(Names[i], TileMaps[i], Size, PatternSize, Symmetry, MaxBacktracks, NumSeeds);
+			UE_LOG(LogSLTilemap, Display, TEXT("%s: %.3f ms per run, %.0f cells/s, %.0f%% contradictions"), *GetCaseKey(*Case), Case->GetNumberField(TEXT("MeanRunMs")), Case->GetNumberField(TEXT("CellsPerSecond")), 100 * Case->GetNumberField(TEXT("ContradictionRate")));
+			Cases.Add(MakeShared<FJsonValueObject>(Case));
+		}
+	}
+
+	const TSharedRef<FJsonObject> Results = MakeShared<FJsonObject>();
+	Results->SetStringField(TEXT("Corpus"), CorpusPath);
+	Results->SetNumberField(TEXT("Seeds"), NumSeeds);
+	Results->SetArrayField(TEXT("Cases"), Cases);
+	FString ResultsString;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ResultsString);
+	FJsonSerializer::Serialize(Results, Writer);
+	if (!FFileHelper::SaveStringToFile(ResultsString, *OutputPath))
+	{
+		UE_LOG(LogSLTilemap, Error, TEXT("Could not write benchmark results to %s"), *OutputPath);
+		return 1;
+	}
+	UE_LOG(LogSLTilemap, Display, TEXT("Wrote benchmark results to %s"), *OutputPath);
+
+	return BaselinePath.IsEmpty() ? 0 : CompareToBaseline(Cases, BaselinePath, Tolerance);
+}
+
+bool USLTilemapBenchmarkCommandlet::LoadCorpus(const FString& Path, TArray<FString>& OutNames, TArray<FTileMap>& OutTileMaps)
+{
+	FString JsonString;
+	TArray<TSharedPtr<FJsonValue>> Entries;
+	if (!FFileHelper::LoadFileToString(JsonString, *Path) || !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(JsonString), Entries))
+	{
+		return false;
+	}
+	for (const TSharedPtr<FJsonValue>& Entry : Entries)
+	{
+		const TSharedPtr<FJsonObject> Object = Entry->Type == EJson::Object ? Entry->AsObject() : nullptr;
+		if (!Object)
+		{
+			UE_LOG(LogSLTilemap, Warning, TEXT("Skipping an entry of %s that isn't an object"), *Path);
+			continue;
+		}
+		const TArray<TSharedPtr<FJsonValue>>& Data = Object->GetArrayField(TEXT("data"));
+		FTileMap TileMap = FTileMap(Object->GetIntegerField(TEXT("width")), Object->GetIntegerField(TEXT("height")));
+		if (Data.Num() != TileMap.Data.Num())
+		{
+			return false;
+		}
+		for (int32 i = 0; i < Data.Num(); i++)
+		{
+			TileMap.Data[i] = static_cast<uint8>(Data[i]->AsNumber());
+		}
+		OutNames.Add(Object->GetStringField(TEXT("Name")));
+		OutTileMaps.Add(MoveTemp(TileMap));
+	}
+	return OutTileMaps.Num() > 0;
+}
+
+TSharedPtr<FJsonObject> USLTilemapBenchmarkCommandlet::RunCase(const FString& Name, const FTileMap& InputTileMap, const int32 Size, const int32 PatternSize, const int32 Symmetry, const int32 MaxBacktracks, const int32 NumSeeds)
+{
+	double GeneratePatternsMs = 0;
+	double InitializeMs = 0;
+	double StepMs = 0;
+	double RunMs = 0;
+	double MinRunMs = MAX_dbl;
+	double MaxRunMs = 0;
+	int64 NumSteps = 0;
+	int64 ObservedCells = 0;
+	int64 MaxResidentBytes = 0;
+	FMemoryDelta GeneratePatternsMemory;
+	FMemoryDelta InitializeMemory;
+	FMemoryDelta StepMemory;
+	FMemoryDelta RunMemory;
+	int32 NumContradictions = 0;
+	int32 NumBacktracks = 0;
+	FWaveStats Stats;
+	for (int32 Seed = 0; Seed < NumSeeds; Seed++)
+	{
+		//A new wave per seed so every run pays for its own pattern tables and allocations
+		USLWave* Wave = NewObject<USLWave>(GetTransientPackage());
+		Wave->InputTileMap = InputTileMap;
+		Wave->OutputTileMap = FTileMap(Size, Size, 0xFF);
+		Wave->PatternSize = PatternSize;
+		Wave->Symmetry = Symmetry;
+		Wave->MaxBacktracks = MaxBacktracks;
+		Wave->Seed = Seed;
+
+		//USLWave::Run split into its phases so each one's memory can be measured, and tagged for runs with -LLM
+		const FMemoryDelta RunStart = GetMemory(*Wave);
+		const double StartTime = FPlatformTime::Seconds();
+		bool Prepared;
+		{
+			LLM_SCOPE_BYNAME(TEXT("SLTilemap/GeneratePatterns"));
+			Prepared = Wave->PrepareModel();
+		}
+		const double PreparedTime = FPlatformTime::Seconds();
+		const FMemoryDelta PreparedMemory = GetMemory(*Wave);
+		bool Initialized;
+		{
+			LLM_SCOPE_BYNAME(TEXT("SLTilemap/Initialize"));
+			Initialized = Prepared && Wave->Initialize();
+		}
+		const FMemoryDelta InitializeEnd = GetMemory(*Wave);
+		bool Stepped = Initialized;
+		{
+			LLM_SCOPE_BYNAME(TEXT("SLTilemap/Step"));
+			while (Stepped)
+			{
+				const FMemoryDelta StepStart = GetMemory(*Wave);
+				Stepped = Wave->Step();
+				StepMemory += GetMemory(*Wave) - StepStart;
+			}
+		}
+		const double EndTime = FPlatformTime::Seconds();
+		const bool Solved = Initialized && !Wave->HasFailed();
+		GeneratePatternsMemory += PreparedMemory - RunStart;
+		InitializeMemory += InitializeEnd - PreparedMemory;
+		RunMemory += GetMemory(*Wave) - RunStart;
+
+		Stats = Wave->GetStats();
+		const double ThisRunMs = 1000 * (EndTime - StartTime);
+		GeneratePatternsMs += 1000 * (PreparedTime - StartTime);
+		InitializeMs += Stats.InitializeMs;
+		StepMs += Stats.StepMs;
+		NumSteps += Stats.NumSteps;
+		RunMs += ThisRunMs;
+		MinRunMs = FMath::Min(MinRunMs, ThisRunMs);
+		MaxRunMs = FMath::Max(MaxRunMs, ThisRunMs);
+		ObservedCells += FMath::RoundToInt(Wave->GetProgress() * Stats.NumCells);
+		MaxResidentBytes = FMath::Max(MaxResidentBytes, static_cast<int64>(Wave->GetAllocatedSize()));
+		NumContradictions += Solved ? 0 : 1;
+		NumBacktracks += Wave->GetBacktrackCount();
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	}
+
+	const int32 NumRuns = FMath::Max(NumSeeds, 1);
+	const TSharedPtr<FJsonObject> Case = MakeShared<FJsonObject>();
+	Case->SetStringField(TEXT("Name"), Name);
+	Case->SetNumberField(TEXT("InputSizeX"), InputTileMap.SizeX);
+	Case->SetNumberField(TEXT("InputSizeY"), InputTileMap.SizeY);
+	Case->SetNumberField(TEXT("OutputSize"), Size);
+	Case->SetNumberField(TEXT("PatternSize"), PatternSize);
+	Case->SetNumberField(TEXT("Symmetry"), Symmetry);
+	Case->SetNumberField(TEXT("MaxBacktracks"), MaxBacktracks);
+	Case->SetNumberField(TEXT("Runs"), NumSeeds);
+	Case->SetNumberField(TEXT("NumPatterns"), Stats.NumPatterns);
+	Case->SetNumberField(TEXT("NumCells"), Stats.NumCells);
+	Case->SetNumberField(TEXT("MeanGeneratePatternsMs"), GeneratePatternsMs / NumRuns);
+	Case->SetNumberField(TEXT("MeanInitializeMs"), InitializeMs / NumRuns);
+	Case->SetNumberField(TEXT("MeanStepMs"), NumSteps > 0 ? StepMs / NumSteps : 0);
+	Case->SetNumberField(TEXT("MeanRunMs"), RunMs / NumRuns);
+	Case->SetNumberField(TEXT("MinRunMs"), NumSeeds > 0 ? MinRunMs : 0);
+	Case->SetNumberField(TEXT("MaxRunMs"), MaxRunMs);
+	Case->SetNumberField(TEXT("CellsPerSecond"), RunMs > 0 ? 1000 * ObservedCells / RunMs : 0);
+	Case->SetNumberField(TEXT("ContradictionRate"), static_cast<double>(NumContradictions) / NumRuns);
+	Case->SetNumberField(TEXT("Backtracks"), NumBacktracks);
+	//Memory taken during each phase, per run except for Step which is per step
+	SetMemoryFields(*Case, TEXT("GeneratePatterns"), GeneratePatternsMemory, NumRuns);
+	SetMemoryFields(*Case, TEXT("Initialize"), InitializeMemory, NumRuns);
+	SetMemoryFields(*Case, TEXT("Step"), StepMemory, FMath::Max<int64>(NumSteps, 1));
+	SetMemoryFields(*Case, TEXT("Run"), RunMemory, NumRuns);
+	//Solver state still held at the end of the largest run, journals included, which says nothing of the peak during it
+	Case->SetNumberField(TEXT("MaxResidentBytes"), MaxResidentBytes);
+	return Case;
+}
+
+int32 USLTilemapBenchmarkCommandlet::CompareToBaseline(const TArray<TSharedPtr<FJsonValue>>& Cases, const FString& BaselinePath, const float Tolerance)
+{
+	FString JsonString;
+	TSharedPtr<FJsonObject> Baseline;
+	if (!FFileHelper::LoadFileToString(JsonString, *BaselinePath) || !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(JsonString), Baseline))
+	{
+		UE_LOG(LogSLTilemap, Error, TEXT("Could not read benchmark baseline %s"), *BaselinePath);
+		return 1;
+	}
+	TMap<FString, double> BaselineRunMs;
+	for (const TSharedPtr<FJsonValue>& Case : Baseline->GetArrayField(TEXT("Cases")))
+	{
+		BaselineRunMs.Add(GetCaseKey(*Case->AsObject()), Case->AsObject()->GetNumberField(TEXT("MeanRunMs")));
+	}
+
+	int32 NumRegressions = 0;
+	for (const TSharedPtr<FJsonValue>& Case : Cases)
+	{
+		const FString Key = GetCaseKey(*Case->AsObject());
+		const double RunMs = Case->AsObject()->GetNumberField(TEXT("MeanRunMs"));
+		const double* BaselineMs = BaselineRunMs.Find(Key);
+		if (!BaselineMs)
+		{
+			UE_LOG(LogSLTilemap, Warning, TEXT("%s has no baseline"), *Key);
+		}
+		else if (RunMs > *BaselineMs * (1 + Tolerance))
+		{
+			UE_LOG(LogSLTilemap, Error, TEXT("%s regressed from %.3f ms to %.3f ms per run"), *Key, *BaselineMs, RunMs);
+			NumRegressions++;
+		}
+	}
+	return NumRegressions > 0 ? 1 : 0;
+}
+
+FString USLTilemapBenchmarkCommandlet::GetCaseKey(const FJsonObject& Case)
+{
+	//Every setting of the case, so only runs of the same configuration are compared
+	return FString::Printf(TEXT("%s(%dx%d)/%d/P%d/S%d/B%d/R%d"), *Case.GetStringField(TEXT("Name")),
+		static_cast<int32>(Case.GetNumberField(TEXT("InputSizeX"))), static_cast<int32>(Case.GetNumberField(TEXT("InputSizeY"))),
+		static_cast<int32>(Case.GetNumberField(TEXT("OutputSize"))), static_cast<int32>(Case.GetNumberField(TEXT("PatternSize"))),
+		static_cast<int32>(Case.GetNumberField(TEXT("Symmetry"))), static_cast<int32>(Case.GetNumberField(TEXT("MaxBacktracks"))),
+		static_cast<int32>(Case.GetNumberField(TEXT("Runs"))));
+}
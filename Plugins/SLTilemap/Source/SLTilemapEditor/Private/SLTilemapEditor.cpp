@@ -0,0 +1,6 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+#include "Modules/ModuleManager.h"
+
+//Holds the offline tools, the commandlets, so the runtime module ships without them or their Json dependency
+IMPLEMENT_MODULE(FDefaultModuleImpl, SLTilemapEditor)
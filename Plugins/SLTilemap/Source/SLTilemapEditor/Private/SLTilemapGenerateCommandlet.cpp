@@ -0,0 +1,168 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SLTilemapGenerateCommandlet.h"
+#include "SLTilemap.h"
+#include "SLTilemapFile.h"
+#include "SLWave.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Misc/Paths.h"
+
+
+USLTilemapGenerateCommandlet::USLTilemapGenerateCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 USLTilemapGenerateCommandlet::Main(const FString& Params)
+{
+	FString DataTablePath;
+	FString RowsString;
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Tilemaps/Generated.sltm");
+	FString CompressionString = TEXT("RLE");
+	int32 Count = 16;
+	int32 Width = 64;
+	int32 Height = 64;
+	int32 Seed = 0;
+	int32 PatternSize = 3;
+	int32 Symmetry = 8;
+	int32 MaxBacktracks = 0;
+	int32 Attempts = 4;
+	FParse::Value(*Params, TEXT("DataTable="), DataTablePath);
+	FParse::Value(*Params, TEXT("Rows="), RowsString);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	FParse::Value(*Params, TEXT("Count="), Count);
+	FParse::Value(*Params, TEXT("Width="), Width);
+	FParse::Value(*Params, TEXT("Height="), Height);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("PatternSize="), PatternSize);
+	FParse::Value(*Params, TEXT("Symmetry="), Symmetry);
+	FParse::Value(*Params, TEXT("MaxBacktracks="), MaxBacktracks);
+	FParse::Value(*Params, TEXT("Attempts="), Attempts);
+	FParse::Value(*Params, TEXT("Compression="), CompressionString);
+	ETileMapCompression Compression;
+	if (CompressionString == TEXT("None"))
+	{
+		Compression = ETileMapCompression::None;
+	}
+	else if (CompressionString == TEXT("RLE"))
+	{
+		Compression = ETileMapCompression::RLE;
+	}
+	else if (CompressionString == TEXT("LZ4"))
+	{
+		Compression = ETileMapCompression::LZ4;
+	}
+	else
+	{
+		UE_LOG(LogSLTilemap, Error, TEXT("Unknown compression %s, use None, RLE or LZ4"), *CompressionString);
+		return 1;
+	}
+
+	const UDataTable* DataTable = LoadObject<UDataTable>(nullptr, *DataTablePath);
+	if (!DataTable || !DataTable->GetRowStruct() || !DataTable->GetRowStruct()->IsChildOf(FTileMap::StaticStruct()))
+	{
+		UE_LOG(LogSLTilemap, Error, TEXT("%s is not a DataTable of FTileMap rows"), *DataTablePath);
+		return 1;
+	}
+	TArray<FName> RowNames = DataTable->GetRowNames();
+	if (!RowsString.IsEmpty())
+	{
+		TArray<FString> RowStrings;
+		RowsString.ParseIntoArray(RowStrings, TEXT(","));
+		RowNames.Reset();
+		for (const FString& RowString : RowStrings)
+		{
+			RowNames.Add(FName(*RowString));
+		}
+	}
+
+	//One job per output, grouped by row so waves mostly keep their pattern tables from one job to the next
+	TArray<const FTileMap*> JobInputs;
+	TArray<FString> JobNames;
+	for (const FName& RowName : RowNames)
+	{
+		const FTileMap* Row = DataTable->FindRow<FTileMap>(RowName, TEXT("SLTilemapGenerate"));
+		if (!Row)
+		{
+			continue;
+		}
+		for (int32 i = 0; i < Count; i++)
+		{
+			JobInputs.Add(Row);
+			JobNames.Add(FString::Printf(TEXT("%s_%d"), *RowName.ToString(), i));
+		}
+	}
+	if (JobInputs.Num() == 0)
+	{
+		UE_LOG(LogSLTilemap, Error, TEXT("Nothing to generate from %s"), *DataTablePath);
+		return 1;
+	}
+
+	//One wave per worker, created up front since UObjects are created on the game thread
+	const int32 NumWorkers = FMath::Min(FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, JobInputs.Num());
+	TArray<USLWave*> Waves;
+	for (int32 i = 0; i < NumWorkers; i++)
+	{
+		USLWave* Wave = NewObject<USLWave>(GetTransientPackage());
+		Wave->AddToRoot();
+		Wave->PatternSize = PatternSize;
+		Wave->Symmetry = Symmetry;
+		Wave->MaxBacktracks = MaxBacktracks;
+		Waves.Add(Wave);
+	}
+
+	//Workers pull jobs until none are left, seeds depend only on the job so output doesn't depend on scheduling
+	const double StartTime = FPlatformTime::Seconds();
+	TArray<FTileMap> Outputs;
+	Outputs.SetNum(JobInputs.Num());
+	TArray<bool> JobSolved;
+	JobSolved.Init(false, JobInputs.Num());
+	FThreadSafeCounter NextJob;
+	ParallelFor(NumWorkers, [&](const int32 WorkerIndex)
+	{
+		USLWave* Wave = Waves[WorkerIndex];
+		for (int32 JobIndex = NextJob.Increment() - 1; JobIndex < JobInputs.Num(); JobIndex = NextJob.Increment() - 1)
+		{
+			Wave->InputTileMap = *JobInputs[JobIndex];
+			for (int32 Attempt = 0; Attempt < Attempts && !JobSolved[JobIndex]; Attempt++)
+			{
+				Wave->OutputTileMap = FTileMap(Width, Height, 0xFF);
+				Wave->Seed = Seed + JobIndex + Attempt * JobInputs.Num();
+				JobSolved[JobIndex] = Wave->Run();
+			}
+			Outputs[JobIndex] = Wave->OutputTileMap;
+		}
+	});
+	for (USLWave* Wave : Waves)
+	{
+		Wave->RemoveFromRoot();
+	}
+
+	TArray<FString> Names;
+	TArray<FTileMap> TileMaps;
+	for (int32 JobIndex = 0; JobIndex < JobInputs.Num(); JobIndex++)
+	{
+		if (JobSolved[JobIndex])
+		{
+			Names.Add(JobNames[JobIndex]);
+			TileMaps.Add(MoveTemp(Outputs[JobIndex]));
+		}
+		else
+		{
+			UE_LOG(LogSLTilemap, Warning, TEXT("%s failed after %d attempts"), *JobNames[JobIndex], Attempts);
+		}
+	}
+	const double EndTime = FPlatformTime::Seconds();
+	UE_LOG(LogSLTilemap, Display, TEXT("Generated %d of %d tilemaps on %d workers in %f s"), TileMaps.Num(), JobInputs.Num(), NumWorkers, EndTime - StartTime);
+
+	if (!FTileMapFile::Save(OutputPath, Names, TileMaps, Compression))
+	{
+		UE_LOG(LogSLTilemap, Error, TEXT("Could not write tilemaps to %s"), *OutputPath);
+		return 1;
+	}
+	return TileMaps.Num() == JobInputs.Num() ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SLTilemapLib.h"
+#include "SLTilemapBenchmarkCommandlet.generated.h"
+
+class FJsonObject;
+class FJsonValue;
+
+/**
+ * Headless USLWave benchmark, run with -run=SLTilemapBenchmark.
+ * Solves every map in a corpus at each output size with seeds 0 to NumSeeds - 1 and writes per case timings as JSON.
+ *
+ * -Corpus=<json>			maps to solve, defaults to Assets/BenchmarkCorpus.json
+ * -Output=<json>			results, defaults to Saved/Benchmarks/SLTilemapBenchmark.json
+ * -Sizes=32,64				output sizes
+ * -Seeds=8					runs per case
+ * -PatternSize=3 -Symmetry=8 -MaxBacktracks=0
+ * -Baseline=<json>			earlier results, the commandlet fails if a case's mean run time grew by more than -Tolerance=0.2,
+ *							cases are matched on the map and every setting above
+ *
+ * Memory taken by GeneratePatterns, Initialize, every Step and the whole run is reported twice: as solver state from USLWave::GetAllocatedSize,
+ * and as the process' used physical memory from FPlatformMemory::GetStats, which allocator caching and page granularity make coarse.
+ * The phases are also LLM tags under SLTilemap/, so running with -LLM gives their allocations as the engine tracks them.
+ */
+UCLASS()
+class SLTILEMAPEDITOR_API USLTilemapBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+
+public:
+	USLTilemapBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	//Reads maps stored as [{"Name", "width", "height", "data"}], as in Assets/BenchmarkCorpus.json
+	static bool LoadCorpus(const FString& Path, TArray<FString>& OutNames, TArray<FTileMap>& OutTileMaps);
+	static TSharedPtr<FJsonObject> RunCase(const FString& Name, const FTileMap& InputTileMap, const int32 Size, const int32 PatternSize, const int32 Symmetry, const int32 MaxBacktracks, const int32 NumSeeds);
+	static int32 CompareToBaseline(const TArray<TSharedPtr<FJsonValue>>& Cases, const FString& BaselinePath, const float Tolerance);
+	static FString GetCaseKey(const FJsonObject& Case);
+};
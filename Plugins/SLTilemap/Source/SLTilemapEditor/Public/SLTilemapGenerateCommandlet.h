@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SLTilemapLib.h"
+#include "SLTilemapGenerateCommandlet.generated.h"
+
+
+/**
+ * Offline batch generation, run with -run=SLTilemapGenerate.
+ * Solves Count outputs for every FTileMap row of a DataTable on all cores and writes them to one FTileMapFile.
+ *
+ * -DataTable=<object path>	table of FTileMap input rows
+ * -Rows=A,B					only these rows, defaults to all
+ * -Output=<file>				defaults to Saved/Tilemaps/Generated.sltm
+ * -Compression=RLE			None, RLE or LZ4
+ * -Count=16 -Width=64 -Height=64 -Seed=0
+ * -PatternSize=3 -Symmetry=8 -MaxBacktracks=0 -Attempts=4
+ */
+UCLASS()
+class SLTILEMAPEDITOR_API USLTilemapGenerateCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+
+public:
+	USLTilemapGenerateCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
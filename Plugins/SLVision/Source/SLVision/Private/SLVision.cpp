@@ -2,6 +2,8 @@
 
 #include "SLVision.h"
 
+DEFINE_LOG_CATEGORY(LogSLVision);
+
 #define LOCTEXT_NAMESPACE "FSLVisionModule"
 
 void FSLVisionModule::StartupModule()
@@ -1,12 +1,12 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "SLVisionComponent.h"
-#include "DrawDebugHelpers.h"
 #include "SLVisionSubsystem.h"
 
 void USLVisionComponent::CalculateRelativeTargetPoints()
 {
 	RelativeTargetPoints.Empty();
+	InvalidateCachedPolygon();
 
 	switch (VisionShape)
 	{
@@ -88,11 +88,60 @@ void USLVisionComponent::CalculateRelativeTargetPoints()
 	}
 }
 
+void USLVisionComponent::InvalidateCachedPolygon()
+{
+	bCachedPolygonValid = false;
+}
+
+void USLVisionComponent::SetCachedPolygon(const FVisionPolygon& Polygon, const FVector& Location, const float Yaw)
+{
+	CachedPolygon.Origin = Polygon.Origin;
+	CachedPolygon.Vertices.Reset();
+	CachedPolygon.Vertices.Append(Polygon.Vertices);
+	CachedLocation = Location;
+	CachedYaw = Yaw;
+	float MaxDistance = 0;
+	for (auto& RelativeLocation : RelativeTargetPoints)
+	{
+		MaxDistance = FMath::Max(MaxDistance, FVector2D(RelativeLocation).Size());
+	}
+	CachedBounds = FBox2D(FVector2D(Location) - FVector2D(MaxDistance), FVector2D(Location) + FVector2D(MaxDistance));
+	bCachedPolygonValid = true;
+
+	CachedDrawVertices.Reset();
+	CachedDrawIndices.Reset();
+	const int32 NumRimVertices = CachedPolygon.Vertices.Num();
+	if (NumRimVertices < 2)
+	{
+		return;
+	}
+	CachedDrawVertices.Add(FVector4(CachedPolygon.Origin.X, CachedPolygon.Origin.Y, 0, 1));
+	for (auto& Vertex : CachedPolygon.Vertices)
+	{
+		CachedDrawVertices.Add(FVector4(Vertex.X, Vertex.Y, 0, 1));
+	}
+	for (int32 i = 0; i < NumRimVertices; i++)
+	{
+		CachedDrawIndices.Add(0);
+		CachedDrawIndices.Add(1 + i);
+		CachedDrawIndices.Add(1 + (i + 1) % NumRimVertices);
+	}
+}
+
+bool USLVisionComponent::NeedsPolygonUpdate(const float LocationTolerance, const float YawTolerance) const
+{
+	if (!bCachedPolygonValid || FVector::DistSquared2D(GetComponentLocation(), CachedLocation) > LocationTolerance * LocationTolerance)
+	{
+		return true;
+	}
+	//A circle looks the same whichever way it faces
+	return VisionShape != EVisionShape::Circle && FMath::Abs(FRotator::NormalizeAxis(GetComponentRotation().Yaw - CachedYaw)) > YawTolerance;
+}
+
 // Sets default values for this component's properties
 USLVisionComponent::USLVisionComponent()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
+	//The subsystem updates sources, the component itself never ticks
 	PrimaryComponentTick.bCanEverTick = false;
 
 	// ...
@@ -114,12 +163,3 @@ void USLVisionComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 	Super::EndPlay(EndPlayReason);
 }
 
-
-// Called every frame
-void USLVisionComponent::TickComponent(float DeltaTime, ELevelTick TickType,
-                                       FActorComponentTickFunction* ThisTickFunction)
-{
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-
-	// ...
-}
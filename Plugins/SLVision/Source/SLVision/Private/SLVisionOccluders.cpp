@@ -0,0 +1,333 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SLVisionOccluders.h"
+#include "Algo/BinarySearch.h"
+
+
+void FVisionOccluders::Build(const FTileMap& TileMap, const FVector2D& NewMapOrigin, const float NewTileSize, const uint8 NewBlockingTiles)
+{
+	Reset();
+	if (!USLTilemapLib::IsTilemapValid(TileMap) || NewTileSize <= 0)
+	{
+		return;
+	}
+	SizeX = TileMap.SizeX;
+	SizeY = TileMap.SizeY;
+	MapOrigin = NewMapOrigin;
+	TileSize = NewTileSize;
+	BlockingTiles = NewBlockingTiles;
+	BlockingArray.SetNumUninitialized(SizeX * SizeY);
+	for (int32 i = 0; i < SizeX * SizeY; i++)
+	{
+		BlockingArray[i] = (TileMap.Data[i] & BlockingTiles) != 0;
+	}
+
+	NumCellsX = SizeX / CellSize + 1;
+	NumCellsY = SizeY / CellSize + 1;
+	Cells.SetNum(NumCellsX * NumCellsY);
+	for (int32 CellY = 0; CellY < NumCellsY; CellY++)
+	{
+		for (int32 CellX = 0; CellX < NumCellsX; CellX++)
+		{
+			BuildCell(CellX, CellY);
+		}
+	}
+}
+
+bool FVisionOccluders::Update(const FTileMap& TileMap, const TArray<FTileMapRegion>& Regions, TArray<FBox2D>& OutChangedAreas)
+{
+	if (IsEmpty() || TileMap.SizeX != SizeX || TileMap.SizeY != SizeY || TileMap.Data.Num() != SizeX * SizeY)
+	{
+		return false;
+	}
+	TBitArray<> DirtyCells(false, Cells.Num());
+	for (const FTileMapRegion& Region : Regions)
+	{
+		const FIntRect Rect(FMath::Max(Region.X, 0), FMath::Max(Region.Y, 0), FMath::Min(Region.X + Region.SizeX, SizeX), FMath::Min(Region.Y + Region.SizeY, SizeY));
+		bool bChanged = false;
+		for (int32 y = Rect.Min.Y; y < Rect.Max.Y; y++)
+		{
+			for (int32 x = Rect.Min.X; x < Rect.Max.X; x++)
+			{
+				const bool bBlocking = (TileMap.Data[y * SizeX + x] & BlockingTiles) != 0;
+				bChanged |= BlockingArray[y * SizeX + x] != bBlocking;
+				BlockingArray[y * SizeX + x] = bBlocking;
+			}
+		}
+		if (!bChanged)
+		{
+			continue;
+		}
+		//Tile x, y borders the edges and corners from x, y to x + 1, y + 1, so the cells up to one past the region's end are rebuilt
+		for (int32 CellY = Rect.Min.Y / CellSize; CellY <= Rect.Max.Y / CellSize; CellY++)
+		{
+			for (int32 CellX = Rect.Min.X / CellSize; CellX <= Rect.Max.X / CellSize; CellX++)
+			{
+				DirtyCells[CellY * NumCellsX + CellX] = true;
+			}
+		}
+		OutChangedAreas.Add(FBox2D(MapOrigin + FVector2D(Rect.Min) * TileSize, MapOrigin + FVector2D(Rect.Max) * TileSize));
+	}
+	for (TConstSetBitIterator<> It(DirtyCells); It; ++It)
+	{
+		BuildCell(It.GetIndex() % NumCellsX, It.GetIndex() / NumCellsX);
+	}
+	return true;
+}
+
+void FVisionOccluders::Reset()
+{
+	SizeX = 0;
+	SizeY = 0;
+	BlockingArray.Reset();
+	NumCellsX = 0;
+	NumCellsY = 0;
+	Cells.Reset();
+	NumSegments = 0;
+}
+
+bool FVisionOccluders::IsEmpty() const
+{
+	return BlockingArray.Num() == 0;
+}
+
+void FVisionOccluders::ComputeVisibility(const FVector2D& Origin, const TArray<FVector2D>& Boundary, TArray<FVector2D>& OutVertices) const
+{
+	OutVertices.Reset();
+	if (Boundary.Num() < 3)
+	{
+		return;
+	}
+	const FVector2D Start = (Origin - MapOrigin) / TileSize;
+
+	//Boundary around Start in tiles, by angle
+	struct FBoundaryVertex
+	{
+		double Angle;
+		FVector2D Offset;
+	};
+	TArray<FBoundaryVertex> SortedBoundary;
+	SortedBoundary.Reserve(Boundary.Num());
+	double MaxRadius = 0;
+	for (const FVector2D& Vertex : Boundary)
+	{
+		const FVector2D Offset = (Vertex - Origin) / TileSize;
+		SortedBoundary.Add({FMath::Atan2(Offset.Y, Offset.X), Offset});
+		MaxRadius = FMath::Max(MaxRadius, Offset.Size());
+	}
+	SortedBoundary.Sort([](const FBoundaryVertex& A, const FBoundaryVertex& B)
+	{
+		return A.Angle < B.Angle;
+	});
+
+	//One ray per boundary vertex keeps the shape, three per corner in reach see the corner and past both sides of it
+	TArray<double> RayAngles;
+	for (const FBoundaryVertex& Vertex : SortedBoundary)
+	{
+		RayAngles.Add(Vertex.Angle);
+	}
+	if (!IsEmpty())
+	{
+		const int32 MinCellX = FMath::Clamp(FMath::FloorToInt((Start.X - MaxRadius) / CellSize), 0, NumCellsX - 1);
+		const int32 MaxCellX = FMath::Clamp(FMath::FloorToInt((Start.X + MaxRadius) / CellSize), 0, NumCellsX - 1);
+		const int32 MinCellY = FMath::Clamp(FMath::FloorToInt((Start.Y - MaxRadius) / CellSize), 0, NumCellsY - 1);
+		const int32 MaxCellY = FMath::Clamp(FMath::FloorToInt((Start.Y + MaxRadius) / CellSize), 0, NumCellsY - 1);
+		for (int32 CellY = MinCellY; CellY <= MaxCellY; CellY++)
+		{
+			for (int32 CellX = MinCellX; CellX <= MaxCellX; CellX++)
+			{
+				for (const FIntPoint& Corner : Cells[CellY * NumCellsX + CellX].Corners)
+				{
+					const FVector2D Offset = FVector2D(Corner) - Start;
+					if (Offset.SizeSquared() > MaxRadius * MaxRadius)
+					{
+						continue;
+					}
+					const double Angle = FMath::Atan2(Offset.Y, Offset.X);
+					RayAngles.Add(FMath::UnwindRadians(Angle - CornerAngleOffset));
+					RayAngles.Add(Angle);
+					RayAngles.Add(FMath::UnwindRadians(Angle + CornerAngleOffset));
+				}
+			}
+		}
+	}
+	RayAngles.Sort();
+
+	OutVertices.Reserve(RayAngles.Num());
+	for (const double Angle : RayAngles)
+	{
+		const FVector2D Direction(FMath::Cos(Angle), FMath::Sin(Angle));
+
+		//The boundary edge spanning Angle limits the ray
+		const int32 Next = Algo::UpperBoundBy(SortedBoundary, Angle, &FBoundaryVertex::Angle) % SortedBoundary.Num();
+		const int32 Previous = (Next + SortedBoundary.Num() - 1) % SortedBoundary.Num();
+		const FVector2D EdgeStart = SortedBoundary[Previous].Offset;
+		const FVector2D Edge = SortedBoundary[Next].Offset - EdgeStart;
+		const double Denominator = FVector2D::CrossProduct(Direction, Edge);
+		const double MaxDistance = FMath::Abs(Denominator) > SMALL_NUMBER ? FMath::Max(FVector2D::CrossProduct(EdgeStart, Edge) / Denominator, 0.0) : EdgeStart.Size();
+
+		const FVector2D Vertex = Origin + Direction * CastRay(Start, Direction, MaxDistance) * TileSize;
+		if (OutVertices.Num() == 0 || !Vertex.Equals(OutVertices.Last(), 0.01))
+		{
+			OutVertices.Add(Vertex);
+		}
+	}
+
+	//Rays stopping on the same wall leave vertices in a straight line, only the ends of the line are kept
+	int32 NumKept = 0;
+	for (int32 i = 0; i < OutVertices.Num(); i++)
+	{
+		const FVector2D Vertex = OutVertices[i];
+		const FVector2D ToVertex = Vertex - (NumKept > 0 ? OutVertices[NumKept - 1] : OutVertices.Last());
+		const FVector2D FromVertex = OutVertices[(i + 1) % OutVertices.Num()] - Vertex;
+		const bool Straight = FVector2D::DotProduct(ToVertex, FromVertex) > 0 && FMath::Abs(FVector2D::CrossProduct(ToVertex, FromVertex)) <= 1e-6 * ToVertex.Size() * FromVertex.Size();
+		if (!Straight)
+		{
+			OutVertices[NumKept++] = Vertex;
+		}
+	}
+	OutVertices.SetNum(NumKept, false);
+}
+
+int32 FVisionOccluders::GetNumSegments() const
+{
+	return NumSegments;
+}
+
+void FVisionOccluders::GetSegments(TArray<TPair<FVector2D, FVector2D>>& OutSegments) const
+{
+	OutSegments.Reset(NumSegments);
+	for (const FCell& Cell : Cells)
+	{
+		for (const FSegment& Segment : Cell.Segments)
+		{
+			OutSegments.Emplace(MapOrigin + FVector2D(Segment.Start) * TileSize, MapOrigin + FVector2D(Segment.End) * TileSize);
+		}
+	}
+}
+
+bool FVisionOccluders::IsBlocking(const int32 X, const int32 Y) const
+{
+	return X >= 0 && Y >= 0 && X < SizeX && Y < SizeY && BlockingArray[Y * SizeX + X];
+}
+
+int32 FVisionOccluders::GetHorizontalEdge(const int32 X, const int32 Y) const
+{
+	const bool BlockingAbove = IsBlocking(X, Y - 1);
+	const bool BlockingBelow = IsBlocking(X, Y);
+	return BlockingAbove == BlockingBelow ? 0 : (BlockingBelow ? 2 : 1);
+}
+
+int32 FVisionOccluders::GetVerticalEdge(const int32 X, const int32 Y) const
+{
+	const bool BlockingLeft = IsBlocking(X - 1, Y);
+	const bool BlockingRight = IsBlocking(X, Y);
+	return BlockingLeft == BlockingRight ? 0 : (BlockingRight ? 2 : 1);
+}
+
+void FVisionOccluders::BuildCell(const int32 CellX, const int32 CellY)
+{
+	FCell& Cell = Cells[CellY * NumCellsX + CellX];
+	NumSegments -= Cell.Segments.Num();
+	Cell.Segments.Reset();
+	Cell.Corners.Reset();
+	//Corners, and the edges starting on them, from MinX, MinY up to MaxX, MaxY exclusive
+	const int32 MinX = CellX * CellSize;
+	const int32 MinY = CellY * CellSize;
+	const int32 MaxX = FMath::Min(MinX + CellSize, SizeX + 1);
+	const int32 MaxY = FMath::Min(MinY + CellSize, SizeY + 1);
+
+	//Horizontal edges lie between rows y - 1 and y, runs are split where the blocking side changes and at the cell's end
+	const int32 EdgesEndX = FMath::Min(MaxX, SizeX);
+	for (int32 y = MinY; y < MaxY; y++)
+	{
+		int32 RunStart = INDEX_NONE;
+		int32 RunEdge = 0;
+		for (int32 x = MinX; x <= EdgesEndX; x++)
+		{
+			const int32 Edge = x < EdgesEndX ? GetHorizontalEdge(x, y) : 0;
+			if (RunStart != INDEX_NONE && Edge != RunEdge)
+			{
+				Cell.Segments.Add({FIntPoint(RunStart, y), FIntPoint(x, y)});
+				RunStart = INDEX_NONE;
+			}
+			if (Edge != 0 && RunStart == INDEX_NONE)
+			{
+				RunStart = x;
+				RunEdge = Edge;
+			}
+		}
+	}
+	//Vertical edges lie between columns x - 1 and x
+	const int32 EdgesEndY = FMath::Min(MaxY, SizeY);
+	for (int32 x = MinX; x < MaxX; x++)
+	{
+		int32 RunStart = INDEX_NONE;
+		int32 RunEdge = 0;
+		for (int32 y = MinY; y <= EdgesEndY; y++)
+		{
+			const int32 Edge = y < EdgesEndY ? GetVerticalEdge(x, y) : 0;
+			if (RunStart != INDEX_NONE && Edge != RunEdge)
+			{
+				Cell.Segments.Add({FIntPoint(x, RunStart), FIntPoint(x, y)});
+				RunStart = INDEX_NONE;
+			}
+			if (Edge != 0 && RunStart == INDEX_NONE)
+			{
+				RunStart = y;
+				RunEdge = Edge;
+			}
+		}
+	}
+	NumSegments += Cell.Segments.Num();
+
+	//Corners are where a run of edges ends in either direction, which the cell split doesn't change
+	for (int32 y = MinY; y < MaxY; y++)
+	{
+		for (int32 x = MinX; x < MaxX; x++)
+		{
+			if (GetHorizontalEdge(x - 1, y) != GetHorizontalEdge(x, y) || GetVerticalEdge(x, y - 1) != GetVerticalEdge(x, y))
+			{
+				Cell.Corners.Add(FIntPoint(x, y));
+			}
+		}
+	}
+}
+
+double FVisionOccluders::CastRay(const FVector2D& Start, const FVector2D& Direction, const double MaxDistance) const
+{
+	//Steps tile by tile, always crossing whichever of the next vertical or horizontal grid line is nearer
+	int32 X = FMath::FloorToInt(Start.X);
+	int32 Y = FMath::FloorToInt(Start.Y);
+	const int32 StepX = Direction.X > 0 ? 1 : -1;
+	const int32 StepY = Direction.Y > 0 ? 1 : -1;
+	const double DeltaX = Direction.X != 0 ? FMath::Abs(1 / Direction.X) : MaxDistance + 1;
+	const double DeltaY = Direction.Y != 0 ? FMath::Abs(1 / Direction.Y) : MaxDistance + 1;
+	double NextX = Direction.X != 0 ? (Direction.X > 0 ? X + 1 - Start.X : Start.X - X) * DeltaX : MaxDistance + 1;
+	double NextY = Direction.Y != 0 ? (Direction.Y > 0 ? Y + 1 - Start.Y : Start.Y - Y) * DeltaY : MaxDistance + 1;
+	while (true)
+	{
+		double Distance;
+		if (NextX < NextY)
+		{
+			Distance = NextX;
+			NextX += DeltaX;
+			X += StepX;
+		}
+		else
+		{
+			Distance = NextY;
+			NextY += DeltaY;
+			Y += StepY;
+		}
+		if (Distance >= MaxDistance)
+		{
+			return MaxDistance;
+		}
+		if (IsBlocking(X, Y))
+		{
+			return Distance;
+		}
+	}
+}
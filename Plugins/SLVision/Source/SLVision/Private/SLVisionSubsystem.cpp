@@ -2,7 +2,12 @@
 
 
 #include "SLVisionSubsystem.h"
-#include "DrawDebugHelpers.h"
+#include "SLVision.h"
+#include "Async/ParallelFor.h"
+#include "CanvasTypes.h"
+#include "Engine/Canvas.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Kismet/KismetRenderingLibrary.h"
 
 
 void USLVisionSubsystem::Initialize(FSubsystemCollectionBase& Collection)
@@ -11,33 +16,196 @@ void USLVisionSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 
 void USLVisionSubsystem::Deinitialize()
 {
+	//Traces still in flight come back as stale and are dropped
+	CancelPendingTraces();
+	TraceDelegate.Unbind();
 }
 
 void USLVisionSubsystem::AddVisionSource(USLVisionComponent* SourceToAdd)
 {
 	VisionSources.Add(SourceToAdd);
+	bSourcesChanged = true;
 }
 
 void USLVisionSubsystem::RemoveVisionSource(USLVisionComponent* SourceToRemove)
 {
 	VisionSources.Remove(SourceToRemove);
+	bSourcesChanged = true;
 }
 
 void USLVisionSubsystem::CalculateVisionPolygons()
 {
-	VisionPolygons.Empty();
+	if (PendingTraceCount > 0 && (VisionBackend == EVisionBackend::Tilemap || !bAsyncTraces))
+	{
+		//Async traces switched off mid flight must not overwrite the polygons found since
+		CancelPendingTraces();
+	}
+	//Components destroyed without RemoveVisionSource are dropped, the loops below then only see valid sources
+	if (VisionSources.RemoveAll([](const USLVisionComponent* SourceComponent) { return !IsValid(SourceComponent); }) > 0)
+	{
+		bSourcesChanged = true;
+	}
+	if (VisionBackend == EVisionBackend::Tilemap)
+	{
+		CalculateVisionPolygonsFromTilemap();
+		return;
+	}
+	if (bAsyncTraces)
+	{
+		RequestVisionPolygonsAsync();
+		return;
+	}
+	bool bAnyUpdated = false;
 	for (auto SourceComponent : VisionSources)
 	{
-		VisionPolygons.Add(CalculateVisionPolygonFromSource(SourceComponent));
+		if (SourceComponent->NeedsPolygonUpdate(RecomputeDistance, RecomputeYaw))
+		{
+			SourceComponent->SetCachedPolygon(CalculateVisionPolygonFromSource(SourceComponent), SourceComponent->GetComponentLocation(), SourceComponent->GetComponentRotation().Yaw);
+			bAnyUpdated = true;
+		}
 	}
+	CollectCachedPolygons(bAnyUpdated);
 }
 
 void USLVisionSubsystem::CalculateVisionTriangles()
 {
-	VisionTriangles.Empty();
+	//Filled in place, VisionTriangles keeps its allocation from one update to the next
+	int32 NumTriangles = 0;
+	for (auto& Polygon : VisionPolygons)
+	{
+		NumTriangles += Polygon.Vertices.Num();
+	}
+	const int32 NumOldTriangles = VisionTriangles.Num();
+	VisionTriangles.SetNum(NumTriangles, false);
+	const FColor Color = FColor(255, 255, 255, 255);
+	for (int32 i = NumOldTriangles; i < NumTriangles; i++)
+	{
+		VisionTriangles[i].V0_Color = Color;
+		VisionTriangles[i].V1_Color = Color;
+		VisionTriangles[i].V2_Color = Color;
+	}
+
+	int32 TriangleIndex = 0;
 	for (auto& Polygon : VisionPolygons)
 	{
-		VisionTriangles.Append(CalculateVisionTrianglesFromPolygon(Polygon));
+		const FVector2D Origin = WorldToRenderTarget(Polygon.Origin);
+		const int32 NumVertices = Polygon.Vertices.Num();
+		for (int32 i = 0; i < NumVertices; i++)
+		{
+			FCanvasUVTri& Triangle = VisionTriangles[TriangleIndex++];
+			Triangle.V0_Pos = Origin;
+			Triangle.V1_Pos = WorldToRenderTarget(Polygon.Vertices[i]);
+			Triangle.V2_Pos = WorldToRenderTarget(Polygon.Vertices[(i + 1) % NumVertices]);
+		}
+	}
+}
+
+void USLVisionSubsystem::DrawVisionPolygons(UTextureRenderTarget2D* RenderTarget, const FLinearColor Color, const bool bClearRenderTarget)
+{
+	if (!RenderTarget)
+	{
+		return;
+	}
+	if (bClearRenderTarget)
+	{
+		UKismetRenderingLibrary::ClearRenderTarget2D(this, RenderTarget, FLinearColor::Black);
+	}
+	UCanvas* Canvas;
+	FVector2D Size;
+	FDrawToRenderTargetContext Context;
+	UKismetRenderingLibrary::BeginDrawCanvasToRenderTarget(this, RenderTarget, Canvas, Size, Context);
+	if (!Canvas)
+	{
+		return;
+	}
+
+	//Only sources with a fan are drawn, so the reserve matches what is added
+	int32 NumVertices = 0;
+	int32 NumTriangles = 0;
+	for (auto SourceComponent : VisionSources)
+	{
+		if (!IsValid(SourceComponent))
+		{
+			continue;
+		}
+		NumVertices += SourceComponent->CachedDrawVertices.Num();
+		NumTriangles += SourceComponent->CachedDrawIndices.Num() / 3;
+	}
+	//The fans are in world units, the canvas maps them as WorldToRenderTarget does
+	const float PixelsPerUU = 1 / UUPerPixel;
+	Canvas->Canvas->PushRelativeTransform(FTranslationMatrix(FVector(-LocalPawnViewLocation.X, -LocalPawnViewLocation.Y, 0))
+		* FScaleMatrix(FVector(PixelsPerUU, PixelsPerUU, 1))
+		* FTranslationMatrix(FVector(RenderTargetSize * 0.5f, RenderTargetSize * 0.5f, 0)));
+	FBatchedElements* BatchedElements = Canvas->Canvas->GetBatchedElements(FCanvas::ET_Triangle, nullptr, GWhiteTexture, SE_BLEND_Opaque);
+	BatchedElements->ReserveVertices(NumVertices);
+	BatchedElements->AddReserveTriangles(NumTriangles, GWhiteTexture, SE_BLEND_Opaque);
+	const FHitProxyId HitProxyId = Canvas->Canvas->GetHitProxyId();
+	for (auto SourceComponent : VisionSources)
+	{
+		if (!IsValid(SourceComponent) || SourceComponent->CachedDrawVertices.Num() == 0)
+		{
+			continue;
+		}
+		const TArray<FVector4>& Vertices = SourceComponent->CachedDrawVertices;
+		//Vertices are added consecutively, the fan's indices are relative to the first
+		const int32 FirstVertex = BatchedElements->AddVertex(Vertices[0], FVector2D::ZeroVector, Color, HitProxyId);
+		for (int32 i = 1; i < Vertices.Num(); i++)
+		{
+			BatchedElements->AddVertex(Vertices[i], FVector2D::ZeroVector, Color, HitProxyId);
+		}
+		const TArray<int32>& Indices = SourceComponent->CachedDrawIndices;
+		for (int32 i = 0; i < Indices.Num(); i += 3)
+		{
+			BatchedElements->AddTriangle(FirstVertex + Indices[i], FirstVertex + Indices[i + 1], FirstVertex + Indices[i + 2], GWhiteTexture, SE_BLEND_Opaque);
+		}
+	}
+	Canvas->Canvas->PopTransform();
+	UKismetRenderingLibrary::EndDrawCanvasToRenderTarget(this, Context);
+}
+
+bool USLVisionSubsystem::IsTracing() const
+{
+	return PendingTraceCount > 0;
+}
+
+void USLVisionSubsystem::SetOccluderTileMap(const FTileMap& TileMap, const FVector2D MapOrigin, const float TileSize, const int32 BlockingTiles)
+{
+	OccluderMapOrigin = MapOrigin;
+	OccluderTileSize = TileSize;
+	OccluderBlockingTiles = static_cast<uint8>(BlockingTiles);
+	Occluders.Build(TileMap, OccluderMapOrigin, OccluderTileSize, OccluderBlockingTiles);
+	for (auto SourceComponent : VisionSources)
+	{
+		if (IsValid(SourceComponent))
+		{
+			SourceComponent->InvalidateCachedPolygon();
+		}
+	}
+}
+
+void USLVisionSubsystem::UpdateOccluderTileMap(const FTileMap& TileMap, const TArray<FTileMapRegion>& Regions)
+{
+	//A map of another size is built anew, as SetOccluderTileMap would
+	TArray<FBox2D> ChangedAreas;
+	if (!Occluders.Update(TileMap, Regions, ChangedAreas))
+	{
+		SetOccluderTileMap(TileMap, OccluderMapOrigin, OccluderTileSize, OccluderBlockingTiles);
+		return;
+	}
+	for (const FBox2D& Area : ChangedAreas)
+	{
+		InvalidateVisionArea(Area);
+	}
+}
+
+void USLVisionSubsystem::InvalidateVisionArea(const FBox2D& Area)
+{
+	for (auto SourceComponent : VisionSources)
+	{
+		if (IsValid(SourceComponent) && SourceComponent->bCachedPolygonValid && SourceComponent->CachedBounds.Intersect(Area))
+		{
+			SourceComponent->InvalidateCachedPolygon();
+		}
 	}
 }
 
@@ -49,43 +217,216 @@ FVisionPolygon USLVisionSubsystem::CalculateVisionPolygonFromSource(USLVisionCom
 	TArray<FVector> RelativeTargetLocations = SourceComponent->RelativeTargetPoints;
 	TArray<FVector2D> PolygonVertices;
 
-	FCollisionQueryParams TraceParams = FCollisionQueryParams();
-	FHitResult Hit;
-
+	TArray<FVisionRay> Rays;
 	for (auto& RelativeLocation : RelativeTargetLocations)
 	{
 		FVector End = Origin + RelativeLocation.RotateAngleAxis(ViewYaw, FVector(0, 0, 1));
-		GetWorld()->LineTraceSingleByChannel(Hit, Origin, End, ECC_Visibility, TraceParams);
-		PolygonVertices.Add(Hit.bBlockingHit ? FVector2D(Hit.Location) : FVector2D(End));
-		//DrawDebugPoint(GetWorld(),End,5.f,FColor(255,255,255,255));
+		Rays.Add(TraceVisionRay(Origin, End));
+	}
+	for (int32 i = 0; i < Rays.Num(); i++)
+	{
+		PolygonVertices.Add(FVector2D(Rays[i].Location));
+		if (SourceComponent->bAdaptiveRays)
+		{
+			RefineVisionRays(Origin, Rays[i], Rays[(i + 1) % Rays.Num()], SourceComponent->RayPrecision, MaxRayRefinements, PolygonVertices);
+		}
 	}
 	return FVisionPolygon(FVector2D(Origin), PolygonVertices);
 }
 
-TArray<FCanvasUVTri> USLVisionSubsystem::CalculateVisionTrianglesFromPolygon(FVisionPolygon& SourcePolygon) const
+USLVisionSubsystem::FVisionRay USLVisionSubsystem::TraceVisionRay(const FVector& Origin, const FVector& End) const
 {
-	TArray<FCanvasUVTri> OutTriangles;
-	const int NumTriangles = SourcePolygon.Vertices.Num();
-	const FVector2D PawnView2D = FVector2D(LocalPawnViewLocation);
-	const FVector2D RTCenterPixels = FVector2D(RenderTargetSize * 0.5, RenderTargetSize * 0.5);
-	const FVector2D Origin = SourcePolygon.Origin;
-	FCanvasUVTri TempTriangle;
+	FHitResult Hit;
+	GetWorld()->LineTraceSingleByChannel(Hit, Origin, End, ECC_Visibility, FCollisionQueryParams());
+	FVisionRay Ray;
+	Ray.End = End;
+	Ray.bBlockingHit = Hit.bBlockingHit;
+	Ray.Location = Hit.bBlockingHit ? Hit.Location : End;
+	Ray.Normal = Hit.bBlockingHit ? Hit.ImpactNormal : FVector::ZeroVector;
+	Ray.Fraction = Hit.bBlockingHit ? Hit.Time : 1;
+	return Ray;
+}
 
-	const FColor Color = FColor(255, 255, 255, 255);
-	TempTriangle.V0_Color = Color;
-	TempTriangle.V1_Color = Color;
-	TempTriangle.V2_Color = Color;
+void USLVisionSubsystem::RefineVisionRays(const FVector& Origin, const FVisionRay& A, const FVisionRay& B, const float Precision, const int32 Refinements, TArray<FVector2D>& OutVertices) const
+{
+	if (Refinements == 0)
+	{
+		return;
+	}
+	//Rays ending on one plane, or both on the boundary, already give the straight edge between them
+	if (A.bBlockingHit == B.bBlockingHit && (!A.bBlockingHit || (FVector::DotProduct(A.Normal, B.Normal) > 0.999f && FMath::Abs(FVector::DotProduct(B.Location - A.Location, A.Normal)) < 1)))
+	{
+		return;
+	}
+	//Gap between the rays where the further one stops
+	if (FVector::Dist(A.End, B.End) * FMath::Max(A.Fraction, B.Fraction) <= Precision)
+	{
+		return;
+	}
+	const FVisionRay Middle = TraceVisionRay(Origin, (A.End + B.End) * 0.5f);
+	RefineVisionRays(Origin, A, Middle, Precision, Refinements - 1, OutVertices);
+	OutVertices.Add(FVector2D(Middle.Location));
+	RefineVisionRays(Origin, Middle, B, Precision, Refinements - 1, OutVertices);
+}
+
+void USLVisionSubsystem::RequestVisionPolygonsAsync()
+{
+	if (PendingTraceCount > 0)
+	{
+		if (GFrameCounter - TraceRequestFrame <= MaxTraceFrames)
+		{
+			return;
+		}
+		//Sources of lost traces still need their update, so they are traced again below
+		UE_LOG(LogSLVision, Warning, TEXT("%d vision traces didn't complete in %llu frames, tracing again"), PendingTraceCount, MaxTraceFrames);
+	}
+	CancelPendingTraces();
+	TraceRequestFrame = GFrameCounter;
+	//Each trace keeps a copy of the delegate, with the generation it was requested in
+	TraceDelegate.BindUObject(this, &USLVisionSubsystem::OnTraceCompleted, TraceGeneration);
+
+	//Adaptive rays depend on the rays before them, so those sources are traced right away
+	bool bAnyUpdated = false;
+	const FCollisionQueryParams TraceParams = FCollisionQueryParams();
+	for (auto SourceComponent : VisionSources)
+	{
+		if (!SourceComponent->NeedsPolygonUpdate(RecomputeDistance, RecomputeYaw))
+		{
+			continue;
+		}
+		if (SourceComponent->bAdaptiveRays)
+		{
+			SourceComponent->SetCachedPolygon(CalculateVisionPolygonFromSource(SourceComponent), SourceComponent->GetComponentLocation(), SourceComponent->GetComponentRotation().Yaw);
+			bAnyUpdated = true;
+			continue;
+		}
+		const FVector Origin = SourceComponent->GetComponentLocation();
+		const float ViewYaw = SourceComponent->GetComponentRotation().Yaw;
+		FPendingVisionSource& PendingSource = PendingSources.AddDefaulted_GetRef();
+		PendingSource.Source = SourceComponent;
+		PendingSource.Location = Origin;
+		PendingSource.Yaw = ViewYaw;
+		PendingSource.FirstVertex = PendingVertices.Num();
+		PendingSource.NumVertices = SourceComponent->RelativeTargetPoints.Num();
+		for (auto& RelativeLocation : SourceComponent->RelativeTargetPoints)
+		{
+			const FVector End = Origin + RelativeLocation.RotateAngleAxis(ViewYaw, FVector(0, 0, 1));
+			//The vertex index comes back as the trace's user data
+			const int32 VertexIndex = PendingVertices.Add(FVector2D(End));
+			GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, Origin, End, ECC_Visibility, TraceParams, FCollisionResponseParams::DefaultResponseParam, &TraceDelegate, VertexIndex);
+		}
+	}
+	PendingTraceCount = PendingVertices.Num();
+	if (PendingTraceCount == 0)
+	{
+		CollectCachedPolygons(bAnyUpdated);
+	}
+}
+
+void USLVisionSubsystem::OnTraceCompleted(const FTraceHandle& Handle, FTraceDatum& Datum, const uint32 Generation)
+{
+	if (Generation != TraceGeneration || PendingTraceCount == 0)
+	{
+		return;
+	}
+	if (Datum.OutHits.Num() > 0 && Datum.OutHits[0].bBlockingHit)
+	{
+		PendingVertices[Datum.UserData] = FVector2D(Datum.OutHits[0].Location);
+	}
+	PendingTraceCount--;
+	if (PendingTraceCount > 0)
+	{
+		return;
+	}
+
+	//Sources removed while their traces were in flight are skipped
+	for (const FPendingVisionSource& PendingSource : PendingSources)
+	{
+		if (USLVisionComponent* SourceComponent = PendingSource.Source.Get())
+		{
+			const FVisionPolygon Polygon(FVector2D(PendingSource.Location), TArray<FVector2D>(PendingVertices.GetData() + PendingSource.FirstVertex, PendingSource.NumVertices));
+			SourceComponent->SetCachedPolygon(Polygon, PendingSource.Location, PendingSource.Yaw);
+		}
+	}
+	CollectCachedPolygons(true);
+}
+
+void USLVisionSubsystem::CancelPendingTraces()
+{
+	TraceGeneration++;
+	PendingTraceCount = 0;
+	PendingSources.Reset();
+	PendingVertices.Reset();
+}
 
-	for (int i = 0; i < NumTriangles; i++)
+void USLVisionSubsystem::CalculateVisionPolygonsFromTilemap()
+{
+	//Components are only read on the game thread, the workers get each moved source's origin and ray ends
+	TArray<USLVisionComponent*> SourcesToUpdate;
+	TArray<FVector> Locations;
+	TArray<float> Yaws;
+	TArray<TArray<FVector2D>> Boundaries;
+	for (auto SourceComponent : VisionSources)
+	{
+		if (!SourceComponent->NeedsPolygonUpdate(RecomputeDistance, RecomputeYaw))
+		{
+			continue;
+		}
+		const FVector Origin = SourceComponent->GetComponentLocation();
+		const float ViewYaw = SourceComponent->GetComponentRotation().Yaw;
+		SourcesToUpdate.Add(SourceComponent);
+		Locations.Add(Origin);
+		Yaws.Add(ViewYaw);
+		TArray<FVector2D>& Boundary = Boundaries.AddDefaulted_GetRef();
+		Boundary.Reserve(SourceComponent->RelativeTargetPoints.Num());
+		for (auto& RelativeLocation : SourceComponent->RelativeTargetPoints)
+		{
+			Boundary.Add(FVector2D(Origin + RelativeLocation.RotateAngleAxis(ViewYaw, FVector(0, 0, 1))));
+		}
+	}
+	TArray<FVisionPolygon> Polygons;
+	Polygons.SetNum(SourcesToUpdate.Num());
+	ParallelFor(SourcesToUpdate.Num(), [&](const int32 i)
+	{
+		Polygons[i].Origin = FVector2D(Locations[i]);
+		Occluders.ComputeVisibility(Polygons[i].Origin, Boundaries[i], Polygons[i].Vertices);
+	});
+	for (int32 i = 0; i < SourcesToUpdate.Num(); i++)
 	{
-		int j = (i + 1) % NumTriangles;
-		FVector2D Vertex1 = SourcePolygon.Vertices[i];
-		FVector2D Vertex2 = SourcePolygon.Vertices[j];
-		TempTriangle.V0_Pos = (Origin - PawnView2D) / UUPerPixel + RTCenterPixels;
-		TempTriangle.V1_Pos = (Vertex1 - PawnView2D) / UUPerPixel + RTCenterPixels;
-		TempTriangle.V2_Pos = (Vertex2 - PawnView2D) / UUPerPixel + RTCenterPixels;
+		SourcesToUpdate[i]->SetCachedPolygon(Polygons[i], Locations[i], Yaws[i]);
+	}
+	CollectCachedPolygons(SourcesToUpdate.Num() > 0);
+}
 
-		OutTriangles.Add(TempTriangle);
+void USLVisionSubsystem::CollectCachedPolygons(const bool bAnyUpdated)
+{
+	if (!bAnyUpdated && !bSourcesChanged)
+	{
+		return;
+	}
+	//Copied in place so each polygon keeps its allocation while its vertex count doesn't grow
+	//Sources destroyed since the last CalculateVisionPolygons, as async traces complete, are skipped
+	bSourcesChanged = false;
+	VisionPolygons.SetNum(VisionSources.Num(), false);
+	int32 NumPolygons = 0;
+	for (auto SourceComponent : VisionSources)
+	{
+		if (!IsValid(SourceComponent))
+		{
+			continue;
+		}
+		FVisionPolygon& Polygon = VisionPolygons[NumPolygons++];
+		Polygon.Origin = SourceComponent->CachedPolygon.Origin;
+		Polygon.Vertices.Reset();
+		Polygon.Vertices.Append(SourceComponent->CachedPolygon.Vertices);
 	}
-	return OutTriangles;
+	VisionPolygons.SetNum(NumPolygons, false);
+	OnVisionPolygonsUpdated.Broadcast();
+}
+
+FVector2D USLVisionSubsystem::WorldToRenderTarget(const FVector2D& Location) const
+{
+	const FVector2D PawnView2D = FVector2D(LocalPawnViewLocation);
+	const FVector2D RTCenterPixels = FVector2D(RenderTargetSize * 0.5, RenderTargetSize * 0.5);
+	return (Location - PawnView2D) / UUPerPixel + RTCenterPixels;
 }
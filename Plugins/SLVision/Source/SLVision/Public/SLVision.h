@@ -5,6 +5,8 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+SLVISION_API DECLARE_LOG_CATEGORY_EXTERN(LogSLVision, Log, All);
+
 class FSLVisionModule : public IModuleInterface
 {
 public:
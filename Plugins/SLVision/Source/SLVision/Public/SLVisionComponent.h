@@ -26,9 +26,38 @@ public:
 	float DistanceBetweenPoints = 100;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision")
 	TArray<FVector> RelativeTargetPoints;
+	//With traces, RelativeTargetPoints are a coarse set and more rays are cast only between neighbours that hit different surfaces or miss and hit,
+	//so DistanceBetweenPoints can be several times larger for the same corners
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision")
+	bool bAdaptiveRays = false;
+	//Adaptive rays stop splitting once neighbours end closer than this
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision", meta = (EditCondition = "bAdaptiveRays", ClampMin = "0.1"))
+	float RayPrecision = 5;
+	//Last polygon USLVisionSubsystem found for this source, kept until the source moves or its area changes
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Vision")
+	FVisionPolygon CachedPolygon;
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Vision")
+	FVector CachedLocation = FVector::ZeroVector;
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Vision")
+	float CachedYaw = 0;
+	//Area the cached polygon could cover, around CachedLocation as far as the furthest target point
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Vision")
+	FBox2D CachedBounds = FBox2D(ForceInit);
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Vision")
+	bool bCachedPolygonValid = false;
+	//CachedPolygon as a fan for USLVisionSubsystem::DrawVisionPolygons, the origin then the rim in world units, rebuilt only with the polygon
+	//and empty when it has fewer than 2 vertices, so nothing is drawn
+	TArray<FVector4> CachedDrawVertices;
+	TArray<int32> CachedDrawIndices;
 
 	UFUNCTION(Blueprintcallable, Category = "Vision")
 	void CalculateRelativeTargetPoints();
+	//Makes the subsystem find this source's polygon again on its next CalculateVisionPolygons
+	UFUNCTION(Blueprintcallable, Category = "Vision")
+	void InvalidateCachedPolygon();
+	void SetCachedPolygon(const FVisionPolygon& Polygon, const FVector& Location, const float Yaw);
+	//True when there is no cached polygon or the source moved more than LocationTolerance or turned more than YawTolerance degrees since
+	bool NeedsPolygonUpdate(const float LocationTolerance, const float YawTolerance) const;
 
 	// Sets default values for this component's properties
 	USLVisionComponent();
@@ -37,10 +66,4 @@ protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
-
-
-public:
-	// Called every frame
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType,
-	                           FActorComponentTickFunction* ThisTickFunction) override;
 };
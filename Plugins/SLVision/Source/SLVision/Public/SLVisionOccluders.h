@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SLTilemapLib.h"
+
+/**
+ * 2D occluders read from an FTileMap, for visibility without physics.
+ * Edges between blocking and open tiles are merged into straight segments, bucketed by area along with the corners they end on,
+ * a visibility polygon casts rays only towards those corners and the boundary's vertices, and marches each ray through the tile grid.
+ * Segments are split where they cross into another bucket, so a change to the map only rebuilds the buckets around it.
+ * Positions are in world space, the map lies on the XY plane with tile 0, 0 starting at MapOrigin.
+ */
+class SLVISION_API FVisionOccluders
+{
+public:
+	//Tiles in BlockingTiles block sight, tiles outside the map don't
+	void Build(const FTileMap& TileMap, const FVector2D& NewMapOrigin, const float NewTileSize, const uint8 NewBlockingTiles);
+	//Reads the tiles of Regions again from TileMap and rebuilds the buckets whose edges they touch, adding the world area of each region
+	//where blocking changed to OutChangedAreas. False, with nothing updated, if TileMap isn't the size of the map last built
+	bool Update(const FTileMap& TileMap, const TArray<FTileMapRegion>& Regions, TArray<FBox2D>& OutChangedAreas);
+	void Reset();
+	bool IsEmpty() const;
+
+	//Visibility polygon around Origin, limited to Boundary, a polygon every point of which Origin sees when there are no walls, like the ends of a vision component's rays
+	void ComputeVisibility(const FVector2D& Origin, const TArray<FVector2D>& Boundary, TArray<FVector2D>& OutVertices) const;
+
+	int32 GetNumSegments() const;
+	//Start and end of every segment, in world space
+	void GetSegments(TArray<TPair<FVector2D, FVector2D>>& OutSegments) const;
+
+private:
+	//Corners of a segment, in tile units
+	struct FSegment
+	{
+		FIntPoint Start;
+		FIntPoint End;
+	};
+
+	//Segments and corners whose start lies in one CellSize square of the grid, corners run from 0 to SizeX inclusive
+	struct FCell
+	{
+		TArray<FSegment> Segments;
+		TArray<FIntPoint> Corners;
+	};
+
+	//Tiles per side of the cells segments and corners are bucketed in
+	static constexpr int32 CellSize = 16;
+	//Rays pass this many radians either side of each corner to see past it
+	static constexpr double CornerAngleOffset = 1e-5;
+
+	int32 SizeX = 0;
+	int32 SizeY = 0;
+	FVector2D MapOrigin = FVector2D::ZeroVector;
+	float TileSize = 100;
+	uint8 BlockingTiles = 0;
+	TArray<bool> BlockingArray;
+	int32 NumCellsX = 0;
+	int32 NumCellsY = 0;
+	TArray<FCell> Cells;
+	int32 NumSegments = 0;
+
+	bool IsBlocking(const int32 X, const int32 Y) const;
+	//0 without an edge between tiles X, Y - 1 and X, Y, else 1 when the blocking tile is the first and 2 when it is the second
+	int32 GetHorizontalEdge(const int32 X, const int32 Y) const;
+	//As GetHorizontalEdge, between tiles X - 1, Y and X, Y
+	int32 GetVerticalEdge(const int32 X, const int32 Y) const;
+	//Finds the segments and corners of one cell again, from BlockingArray
+	void BuildCell(const int32 CellX, const int32 CellY);
+	//Distance in tiles along the normalized Direction to the first blocking tile, at most MaxDistance
+	double CastRay(const FVector2D& Start, const FVector2D& Direction, const double MaxDistance) const;
+};
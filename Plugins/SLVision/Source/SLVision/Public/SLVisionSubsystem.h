@@ -5,9 +5,14 @@
 #include "CoreMinimal.h"
 #include "Subsystems/WorldSubsystem.h"
 #include "SLVisionComponent.h"
+#include "SLVisionOccluders.h"
 #include "SLVisionTypes.h"
+#include "WorldCollision.h"
 #include "SLVisionSubsystem.generated.h"
 
+class UTextureRenderTarget2D;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnVisionPolygonsUpdated);
 
 
 UCLASS()
@@ -29,18 +34,100 @@ public:
 	float UUPerPixel = 8;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision")
 	float RenderTargetSize = 2048;
+	//Trace every ray of every source asynchronously, VisionPolygons is then replaced when the traces complete, normally the next frame
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision")
+	bool bAsyncTraces = false;
+	//Tilemap finds polygons without physics from the map given to SetOccluderTileMap, computing sources in parallel
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision")
+	EVisionBackend VisionBackend = EVisionBackend::Traces;
+	//Sources keep their cached polygon until they move further than this or, unless they are circles, turn more than RecomputeYaw degrees
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision")
+	float RecomputeDistance = 1;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vision")
+	float RecomputeYaw = 1;
+
+	//Broadcast whenever VisionPolygons has been replaced
+	UPROPERTY(BlueprintAssignable, Category = "Vision")
+	FOnVisionPolygonsUpdated OnVisionPolygonsUpdated;
 
 	//functions
 	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
 	virtual void Deinitialize() override;
 	void AddVisionSource(USLVisionComponent* SourceToAdd);
 	void RemoveVisionSource(USLVisionComponent* SourceToRemove);
+	//Finds the polygons of sources that moved or were invalidated, VisionPolygons is only replaced when one did
 	UFUNCTION(Blueprintcallable, Category = "Vision")
 	void CalculateVisionPolygons();
 	UFUNCTION(Blueprintcallable, Category = "Vision")
 	void CalculateVisionTriangles();
+	//Draws every source's cached polygon in one batch, instead of drawing VisionTriangles. The fans are kept on the sources and only rebuilt
+	//with their polygons, each draw submits them again under one world to render target transform. bClearRenderTarget clears to black first
+	UFUNCTION(Blueprintcallable, Category = "Vision")
+	void DrawVisionPolygons(UTextureRenderTarget2D* RenderTarget, const FLinearColor Color = FLinearColor::White, const bool bClearRenderTarget = true);
+	//True while async traces of a CalculateVisionPolygons call are in flight, calls made meanwhile are ignored unless the traces are older than MaxTraceFrames
+	UFUNCTION(BlueprintPure, Category = "Vision")
+	bool IsTracing() const;
+	//Occluders of the Tilemap backend, tile 0, 0 starts at MapOrigin, every source is found again
+	UFUNCTION(Blueprintcallable, Category = "Vision")
+	void SetOccluderTileMap(const FTileMap& TileMap, const FVector2D MapOrigin, const float TileSize = 100, UPARAM(meta = (Bitmask, BitmaskEnum = "ETileState")) const int32 BlockingTiles = 68);
+	//Updates the occluders in Regions from TileMap, placed as in the last SetOccluderTileMap, and invalidates the sources that can see into regions
+	//where blocking changed, the signature of USLTilemapSubsystem::OnTilemapChanged
+	UFUNCTION(Blueprintcallable, Category = "Vision")
+	void UpdateOccluderTileMap(const FTileMap& TileMap, const TArray<FTileMapRegion>& Regions);
+	//Invalidates the cached polygons of sources that can see into Area, for anything that changes what blocks sight
+	UFUNCTION(Blueprintcallable, Category = "Vision")
+	void InvalidateVisionArea(const FBox2D& Area);
 
 private:
+	//One traced ray, towards End
+	struct FVisionRay
+	{
+		FVector End;
+		FVector Location;
+		FVector Normal;
+		//Part of the way to End the ray got
+		float Fraction;
+		bool bBlockingHit;
+	};
+
+	//Bisections of one interval of adaptive rays
+	static constexpr int32 MaxRayRefinements = 12;
+	//Frames async traces may stay in flight before they are given up on and traced again, should the physics scene drop some
+	static constexpr uint64 MaxTraceFrames = 10;
+
+	//Rays of one source in PendingVertices
+	struct FPendingVisionSource
+	{
+		TWeakObjectPtr<USLVisionComponent> Source;
+		FVector Location;
+		float Yaw;
+		int32 FirstVertex;
+		int32 NumVertices;
+	};
+
+	TArray<FPendingVisionSource> PendingSources;
+	//Ray ends, replaced by the hit location as each trace completes
+	TArray<FVector2D> PendingVertices;
+	int32 PendingTraceCount = 0;
+	//Bumped by every request and cancel, results of other generations are stale and ignored
+	uint32 TraceGeneration = 0;
+	uint64 TraceRequestFrame = 0;
+	FTraceDelegate TraceDelegate;
+	FVisionOccluders Occluders;
+	FVector2D OccluderMapOrigin = FVector2D::ZeroVector;
+	float OccluderTileSize = 100;
+	uint8 OccluderBlockingTiles = 0;
+	//Set when sources are added or removed, so VisionPolygons is replaced even if no polygon changed
+	bool bSourcesChanged = false;
+
 	FVisionPolygon CalculateVisionPolygonFromSource(USLVisionComponent* SourceComponent) const;
-	TArray<FCanvasUVTri> CalculateVisionTrianglesFromPolygon(FVisionPolygon& SourcePolygon) const;
+	FVisionRay TraceVisionRay(const FVector& Origin, const FVector& End) const;
+	//Adds the vertices of rays cast between A and B, while they stop on different surfaces and further than Precision apart
+	void RefineVisionRays(const FVector& Origin, const FVisionRay& A, const FVisionRay& B, const float Precision, const int32 Refinements, TArray<FVector2D>& OutVertices) const;
+	void RequestVisionPolygonsAsync();
+	void OnTraceCompleted(const FTraceHandle& Handle, FTraceDatum& Datum, const uint32 Generation);
+	void CancelPendingTraces();
+	void CalculateVisionPolygonsFromTilemap();
+	void CollectCachedPolygons(const bool bAnyUpdated);
+	FVector2D WorldToRenderTarget(const FVector2D& Location) const;
 };
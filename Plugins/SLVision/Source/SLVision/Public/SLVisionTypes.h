@@ -35,3 +35,12 @@ enum class EVisionShape : uint8
 	Circle,
 	Directional
 };
+
+UENUM(BlueprintType)
+enum class EVisionBackend : uint8
+{
+	//Line traces against the physics scene
+	Traces,
+	//Rays marched through the occluder tilemap, see USLVisionSubsystem::SetOccluderTileMap
+	Tilemap
+};
@@ -27,7 +27,8 @@ public class SLVision : ModuleRules
 		PublicDependencyModuleNames.AddRange(
 			new[]
 			{
-				"Core"
+				"Core",
+				"SLTilemap"
 				// ... add other public dependencies that you statically link with here ...
 			}
 		);
@@ -38,6 +39,7 @@ public class SLVision : ModuleRules
 			{
 				"CoreUObject",
 				"Engine",
+				"RenderCore",
 				"Slate",
 				"SlateCore"
 				// ... add private dependencies that you statically link with here ...	